@@ -0,0 +1,79 @@
+﻿#ifndef AGENT_H
+#define AGENT_H
+
+#include "World.h"
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+
+// Interface for scripted players. Agents only see what a human player sees, through World's percept accessors:
+// the layout, the keys held and whether the current room is near a wumpus, which World shows as each level starts.
+class IAgent
+{
+public:
+    virtual ~IAgent() {}
+
+    virtual std::string getName() const = 0;
+
+    // Called at the start of each game.
+    virtual void reset(const World & world, uint32_t seed) = 0;
+
+    // Returns the direction for the given player to move in from their current room.
+    virtual World::MoveDirection chooseMove(const World & world, int player) = 0;
+};
+
+
+// Agent moving to a random valid neighboring room each turn.
+class RandomAgent : public IAgent
+{
+public:
+    std::string getName() const override
+    {
+        return "random";
+    }
+
+    void reset(const World & world, uint32_t seed) override;
+    World::MoveDirection chooseMove(const World & world, int player) override;
+
+private:
+    std::mt19937 myRng;
+};
+
+
+// Agent exploring rooms known to be safe first, then guessing the unexplored room with the least evidence of a
+// nearby wumpus.
+class CautiousAgent : public IAgent
+{
+public:
+    std::string getName() const override
+    {
+        return "cautious";
+    }
+
+    void reset(const World & world, uint32_t seed) override;
+    World::MoveDirection chooseMove(const World & world, int player) override;
+
+private:
+    enum Percept : int8_t
+    {
+        UNKNOWN = -1,
+        CLEAR = 0,
+        NEAR = 1
+    };
+
+    int chooseTarget(const World & world, int player);
+    World::MoveDirection getFirstStep(const World & world, int player, int target) const;
+
+    int myWidth = 0;
+    int myHeight = 0;
+    int myLastRoom = -1;
+    int myLastTarget = -1;
+    key_mask_t myLastKeys = 0;
+    std::vector<int8_t> myPercepts;
+    std::vector<bool> myBlocked;
+    std::mt19937 myRng;
+};
+
+#endif // AGENT_H
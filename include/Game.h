@@ -2,7 +2,11 @@
 #define GAME_H
 
 #include "OSTerminal.h"
+#include "Spectator.h"
+#include "Telemetry.h"
 #include "World.h"
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread/thread.hpp>
 #include <memory>
 
 
@@ -29,7 +33,8 @@ public:
         MAX
     };
 
-    Game();
+    Game(const std::string & player);
+    ~Game();
 
     void initialize();
     void executiveLoop();
@@ -37,17 +42,35 @@ public:
 private:
     static const std::string myBanner;
     static const std::string myMessages[GameMessage::MAX];
+    static const boost::posix_time::time_duration mySnapshotInterval;
+    static const boost::posix_time::time_duration myTelemetryInterval;
 
     void updateState(const GameState gameState);
     void processSplash();
     void processGame();
     void processGameOver();
+    void preloadLevel(int level);
+    bool advanceLevel();
+    void saveSnapshot();
+    bool restoreSnapshot();
+    void removeSnapshot();
 
+    static std::string getSnapshotPath(const std::string & player);
+    static std::string getTelemetryPath();
+
+    const std::string mySnapshotPath;
+    Telemetry myTelemetry;
     std::unique_ptr<ITerminal> myTerminal;
-    World myActiveWorld;
+    std::unique_ptr<SpectatorBroadcaster> myBroadcaster;
+    std::unique_ptr<World> myActiveWorld;
+    std::unique_ptr<World> myNextWorld;
+    boost::thread myPreloadThread;
+    int myLevel = 0;
     bool myExiting = false;
     GameState myGameState = GameState::splash;
     bool myStateInit = true;
+    bool mySnapshotDirty = false;
+    boost::posix_time::ptime myLastSnapshotTime;
 };
 
 #endif // GAME_H
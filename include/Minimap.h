@@ -0,0 +1,75 @@
+﻿#ifndef MINIMAP_H
+#define MINIMAP_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+
+namespace MinimapProp
+{
+    enum
+    {
+        VALID = 1 << 0,
+        VISITED = 1 << 1,
+        MARK_WUMPUS = 1 << 2,
+        PLAYER = 1 << 3
+    };
+}
+
+
+// Class holding a mip-style pyramid of room summaries for the minimap.
+// Level 0 is the rooms themselves, read through a callback rather than stored; each cell of level k is the OR of the
+// 2x2 block of level k - 1 below it. Changing a room updates at most one cell per level, so the cost per event is
+// O(log n) in the world size, and the stored levels take about a third of a byte per room.
+class Minimap
+{
+public:
+    using room_props_t = std::function<uint8_t(int x, int y)>;
+
+    void resize(int width, int height, int maxColumns, int maxRows, room_props_t roomProps);
+    void buildLevels();
+    bool update(int x, int y);
+
+    int getDisplayWidth() const
+    {
+        return myLevels[myDisplayLevel].width;
+    }
+
+    int getDisplayHeight() const
+    {
+        return myLevels[myDisplayLevel].height;
+    }
+
+    int getDisplayLevel() const
+    {
+        return myDisplayLevel;
+    }
+
+    uint8_t getDisplayCell(int x, int y) const
+    {
+        return getCell(myDisplayLevel, x, y);
+    }
+
+private:
+    struct Level
+    {
+        int width;
+        int height;
+        std::vector<uint8_t> cells;
+    };
+
+    uint8_t getCell(int levelIndex, int x, int y) const
+    {
+        const Level & level = myLevels[levelIndex];
+        return levelIndex ? level.cells[y * level.width + x] : myRoomProps(x, y);
+    }
+
+    uint8_t reduce(int levelIndex, int x, int y) const;
+
+    room_props_t myRoomProps;
+    std::vector<Level> myLevels;
+    int myDisplayLevel = 0;
+};
+
+#endif // MINIMAP_H
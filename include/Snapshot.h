@@ -0,0 +1,31 @@
+﻿#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <type_traits>
+
+
+// Helpers for the binary save snapshot. Values are stored in host byte order, as snapshots are local to a machine.
+namespace Snapshot
+{
+    const uint32_t MAGIC = 0x53504d57; // "WMPS"
+    const uint16_t VERSION = 1;
+
+    template<typename T>
+    void write(std::ostream & os, T value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "Snapshot values must be trivially copyable");
+        os.write(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    template<typename T>
+    bool read(std::istream & is, T & value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "Snapshot values must be trivially copyable");
+        return static_cast<bool>(is.read(reinterpret_cast<char *>(&value), sizeof(value)));
+    }
+}
+
+#endif // SNAPSHOT_H
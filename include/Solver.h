@@ -0,0 +1,113 @@
+﻿#ifndef SOLVER_H
+#define SOLVER_H
+
+#include "World.h"
+#include <array>
+#include <atomic>
+#include <boost/thread/mutex.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+
+// Class computing the exact optimal win probability of a world, given uncertainty about wumpus placement.
+// Every placement of the world's wumpuses over rooms other than the start and treasure is equally likely a priori.
+// The player's knowledge state is the set of visited rooms plus the "near wumpus" percept seen in each of them;
+// since backtracking through visited rooms is always safe, the current position within that set is irrelevant.
+// Keys are always visible, so the keys held are implied by the visited set as well.
+class Solver
+{
+public:
+    static constexpr int MAX_ROOMS = 256;
+
+    Solver(const World::RawData & rawData, int threadCount = 0, std::size_t maxHypotheses = 1000000);
+
+    double solve();
+
+    std::size_t getStatesExplored() const
+    {
+        return myStatesExplored;
+    }
+
+private:
+    // Set of rooms, indexed by (y * width + x).
+    struct RoomSet
+    {
+        std::array<uint64_t, MAX_ROOMS / 64> words{};
+
+        void set(int room)
+        {
+            words[room >> 6] |= (uint64_t(1) << (room & 63));
+        }
+
+        bool test(int room) const
+        {
+            return (words[room >> 6] >> (room & 63)) & 1;
+        }
+
+        RoomSet & operator|=(const RoomSet & other);
+        bool intersects(const RoomSet & other) const;
+        bool operator==(const RoomSet & other) const;
+        bool operator<(const RoomSet & other) const;
+
+        template<typename Func>
+        void forEach(Func func) const;
+    };
+
+    struct Hypothesis
+    {
+        RoomSet wumpus;
+        RoomSet near;
+    };
+
+    struct StateKey
+    {
+        RoomSet visited;
+        RoomSet near;
+
+        bool operator==(const StateKey & other) const
+        {
+            return (visited == other.visited) && (near == other.near);
+        }
+    };
+
+    struct StateKeyHash
+    {
+        std::size_t operator()(const StateKey & key) const;
+    };
+
+    struct TableShard
+    {
+        boost::mutex mutex;
+        std::unordered_map<StateKey, double, StateKeyHash> table;
+    };
+
+    using hypothesis_list_t = std::vector<uint32_t>;
+
+    static constexpr int TABLE_SHARDS = 64;
+    static constexpr int NO_LOCK = -1;
+    static constexpr int NO_KEY = -2;
+
+    void buildHypotheses(const World::RawData & rawData, std::size_t maxHypotheses);
+    void buildSymmetries(const World::RawData & rawData);
+    bool isUnlocked(int room, const RoomSet & visited) const;
+    StateKey getCanonicalKey(const RoomSet & visited, const RoomSet & near) const;
+    bool getCandidateMoves(const RoomSet & visited, const hypothesis_list_t & hyps, std::vector<int> & moves) const;
+    double evaluate(const RoomSet & visited, const RoomSet & near, const hypothesis_list_t & hyps);
+    double evaluateMove(const RoomSet & visited, const RoomSet & near, const hypothesis_list_t & hyps, int room);
+
+    int myWidth = 0;
+    int myHeight = 0;
+    int myStartRoom = 0;
+    int myTreasureRoom = -1;
+    int myThreadCount = 0;
+    std::vector<RoomSet> myNeighbors;
+    std::vector<int> myKeyRooms;
+    std::vector<Hypothesis> myHypotheses;
+    std::vector<std::vector<int>> mySymmetries;
+    std::array<TableShard, TABLE_SHARDS> myTable;
+    std::atomic<std::size_t> myStatesExplored{0};
+};
+
+#endif // SOLVER_H
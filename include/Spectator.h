@@ -0,0 +1,81 @@
+﻿#ifndef SPECTATOR_H
+#define SPECTATOR_H
+
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class ITerminal;
+
+
+namespace SpectatorFrame
+{
+    enum
+    {
+        DELTA,
+        KEYFRAME
+    };
+}
+
+
+// Class publishing what the game draws to a shared-memory ring buffer of frames, for local spectators.
+// Draws are recorded from World's rendering and published once per game loop as a delta frame; keyframes holding
+// the whole screen are published periodically so spectators can join or catch up. Publishing never waits on
+// readers, so the player's latency is unaffected by how many spectators attach.
+class SpectatorBroadcaster
+{
+public:
+    SpectatorBroadcaster(const std::string & name);
+    ~SpectatorBroadcaster();
+
+    // Each game process broadcasts under its own name, so several games can run on one host.
+    static std::string getName(int pid)
+    {
+        return myNamePrefix + std::to_string(pid);
+    }
+
+    void draw(int x, int y, const std::string & text);
+    void clear();
+    void flush();
+
+private:
+    static const int KEYFRAME_INTERVAL = 100;
+    static const std::string myNamePrefix;
+
+    void applyToScreen(int x, int y, const std::string & text);
+    void encodeKeyframe();
+    void publish(int frameType);
+
+    std::string myName;
+    boost::interprocess::shared_memory_object mySharedMemory;
+    boost::interprocess::mapped_region myRegion;
+    std::vector<char> myPayload;
+    std::vector<std::vector<std::string>> myScreen;
+    bool myKeyframeNeeded = true;
+    int myFramesSinceKeyframe = 0;
+};
+
+
+// Class attaching read-only to a broadcaster's ring buffer and replaying its frames on a local terminal.
+class SpectatorViewer
+{
+public:
+    SpectatorViewer(const std::string & name, ITerminal * terminal);
+
+    bool attach();
+    void update();
+
+private:
+    void applyFrame(int frameType, const std::vector<char> & payload);
+
+    std::string myName;
+    ITerminal * myTerminal = nullptr;
+    boost::interprocess::shared_memory_object mySharedMemory;
+    boost::interprocess::mapped_region myRegion;
+    uint64_t myNextSequence = 0;
+    bool myKeyframeNeeded = true;
+};
+
+#endif // SPECTATOR_H
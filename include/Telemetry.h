@@ -0,0 +1,84 @@
+﻿#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <array>
+#include <atomic>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace Metric
+{
+    enum
+    {
+        GAMES_STARTED,
+        GAMES_WON,
+        GAMES_LOST,
+        MOVES,
+        BAD_MOVES,
+        MARKS_PLACED,
+        FRAMES_RENDERED,
+        BYTES_WRITTEN,
+        MAX
+    };
+}
+
+
+// Class collecting per-process gameplay counters.
+// Each thread owns a cache-line aligned block of counters that only it writes, so updates need no locks or
+// atomic read-modify-write. An instance runs an exporter thread that sums all blocks and periodically writes
+// them to a Prometheus text format file. Samples carry an instance label, so files from several processes can
+// be collected side by side, and each file is removed when its process exits.
+class Telemetry
+{
+public:
+    Telemetry(const std::string & path, const std::string & instance, boost::posix_time::time_duration interval);
+    ~Telemetry();
+
+    static void increment(int metric, uint64_t amount = 1)
+    {
+        std::atomic<uint64_t> & counter = getThreadCounters().counters[metric];
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    static uint64_t getTotal(int metric);
+
+private:
+    struct alignas(64) CounterBlock
+    {
+        std::array<std::atomic<uint64_t>, Metric::MAX> counters{};
+    };
+
+    struct MetricInfo
+    {
+        const char * name;
+        const char * help;
+    };
+
+    static CounterBlock & getThreadCounters()
+    {
+        thread_local CounterBlock * block = registerThread();
+        return *block;
+    }
+
+    static CounterBlock * registerThread();
+
+    void exportLoop();
+    void exportMetrics() const;
+
+    static const MetricInfo myMetricInfo[Metric::MAX];
+    static boost::mutex myRegistryMutex;
+    static std::vector<std::unique_ptr<CounterBlock>> myRegistry;
+
+    std::string myPath;
+    std::string myInstance;
+    boost::posix_time::time_duration myInterval;
+    boost::thread myExportThread;
+};
+
+#endif // TELEMETRY_H
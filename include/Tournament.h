@@ -0,0 +1,72 @@
+﻿#ifndef TOURNAMENT_H
+#define TOURNAMENT_H
+
+#include "Agent.h"
+#include "World.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+// Class playing every agent against every world many times, headless, on a work-stealing thread pool.
+// Worlds are played as designed, unless added with random wumpuses: then each game draws a fresh placement of the
+// same number of wumpuses over the world's rooms other than the start and treasure.
+class Tournament
+{
+public:
+    using agent_factory_t = std::function<std::unique_ptr<IAgent>()>;
+
+    struct AgentResult
+    {
+        std::string name;
+        uint64_t games = 0;
+        uint64_t wins = 0;
+        uint64_t moves = 0;
+        double seconds = 0.0;
+    };
+
+    // Throws std::runtime_error for worlds that World can't load.
+    void addWorld(const World::RawData & rawData, bool randomWumpuses = false);
+    void addAgent(agent_factory_t factory);
+
+    void run(int gamesPerPair, int threadCount = 0, uint32_t seed = 0);
+    void writeCsv(std::ostream & os) const;
+
+    const std::vector<AgentResult> & getResults() const
+    {
+        return myResults;
+    }
+
+private:
+    static constexpr int GAMES_PER_TASK = 256;
+
+    struct TournamentWorld
+    {
+        World::RawData rawData;
+        std::vector<room_data_t> baseData;
+        std::vector<int> candidates;
+        int wumpusCount;
+        bool randomWumpuses;
+    };
+
+    struct Task
+    {
+        int agent;
+        int world;
+        int firstGame;
+        int gameCount;
+    };
+
+    class WorkStealingQueue;
+
+    void runTask(const Task & task, IAgent & agent, std::vector<room_data_t> & data, uint32_t seed,
+        AgentResult & result) const;
+
+    std::vector<TournamentWorld> myWorlds;
+    std::vector<agent_factory_t> myAgentFactories;
+    std::vector<AgentResult> myResults;
+};
+
+#endif // TOURNAMENT_H
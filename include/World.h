@@ -1,11 +1,21 @@
 ﻿#ifndef WORLD_H
 #define WORLD_H
 
+#include "Minimap.h"
+#include "WorldStorage.h"
+#include <boost/thread/mutex.hpp>
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cstdint>
+#include <iosfwd>
 #include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 class ITerminal;
+class SpectatorBroadcaster;
 
 
 namespace RoomProp
@@ -19,7 +29,8 @@ namespace RoomProp
         TREASURE = 1 << 4,
         DOOR = 1 << 5,
         MARK_WUMPUS = 1 << 6,
-        MARK_UNKNOWN = 1 << 7
+        MARK_UNKNOWN = 1 << 7,
+        VISITED = 1 << 8 // Player overlay only, kept outside the room storage.
     };
 }
 
@@ -61,7 +72,8 @@ namespace SpecialSymbol
         WUMPUS,
         KEY,
         LOCKED,
-        UNKNOWN
+        UNKNOWN,
+        PLAYER
     };
 }
 
@@ -71,21 +83,58 @@ namespace WorldMessage
     {
         CLEAR,
         BADMOVE,
+        LOCKED,
+        KEYFOUND,
         NEARWUMPUS,
         LOSE,
         WIN,
         EXIT,
+        NEXTLEVEL,
         MAX
     };
 }
 
 using room_data_t = uint16_t;
+using key_mask_t = uint32_t;
+
+
+// Room storage used by World, selected at compile time:
+//  WORLD_CELL_TYPE = uint8_t (default), uint16_t or uint32_t
+//  WORLD_TILED_STORAGE defined for TiledStorage, otherwise RowMajorStorage
+#ifndef WORLD_CELL_TYPE
+#define WORLD_CELL_TYPE uint8_t
+#endif
+
+#ifdef WORLD_TILED_STORAGE
+using WorldStorage = TiledStorage<WORLD_CELL_TYPE>;
+#else
+using WorldStorage = RowMajorStorage<WORLD_CELL_TYPE>;
+#endif
 
 
-// Class managing the "world", a set of rooms with various properties.
-class World
+// Class holding what is shared by all worlds: level data, raw data format and rendering tables.
+class WorldBase
 {
 public:
+    // Keys are paired with locked rooms in row-major order: the n-th KEY room opens the n-th LOCKED room.
+    // A world may have at most MAX_KEYS of each.
+    static const int MAX_KEYS = 16;
+
+    // Largest minimap panel, in characters; bigger worlds are shown at a coarser level of the summary pyramid.
+    static const int MINIMAP_COLUMNS = 32;
+    static const int MINIMAP_ROWS = 16;
+
+    // Largest window of rooms drawn on screen; each player's view scrolls over bigger worlds to keep their selection
+    // at least VIEW_MARGIN rooms from its edges. The minimap panel sits to the right of the view.
+    static constexpr int VIEW_COLUMNS = 16;
+    static constexpr int VIEW_ROWS = 10;
+    static constexpr int VIEW_MARGIN = 2;
+
+    // Players share the rooms and wumpuses but each has their own position, selection and marks.
+    // The local player is created with the world and is the one shown on the minimap and to spectators.
+    static const int LOCAL_PLAYER = 0;
+    static const int MAX_PLAYERS = 31;
+
     struct RawData
     {
         int width;
@@ -103,50 +152,256 @@ public:
         right
     };
 
-    World(ITerminal * terminal);
-
-    void load(const RawData & rawData);
-    void render() const;
-    void renderRoom(int x, int y) const;
-    void renderSelectedRoom() const;
-
-    void moveSelection(MoveDirection direction);
-    void move();
-    void toggleWumpus();
-    void toggleUnknown();
-
-    bool isGameOver() const
+    static const RawData & getDefaultRawData()
     {
-        return myGameOver;
+        return myDefaultRawData;
     }
 
-    void dumpRawData();
+    static int getLevelCount();
+    static const RawData & getLevelRawData(int level);
 
-private:
-    void updateKernel(int x, int y) const;
-    std::string getCornerStyle(int xKernel, int yKernel, int drawStyle) const;
-    std::string getRoomContent(int x, int y) const;
-    bool isNearWumpus() const;
-    void displayMessage(const std::string & message, int messageLine) const;
+    // Reads a world file: a "width height startX startY" line followed by one line per row of comma-separated
+    // room properties, as printed by dumpRawData. The rooms are stored in data, which rawData points to.
+    static bool readRawData(std::istream & is, std::vector<room_data_t> & data, RawData & rawData);
 
+protected:
     static const room_data_t myDefaultRoomData[];
     static const RawData myDefaultRawData;
+    static const room_data_t myCavernRoomData[];
+    static const room_data_t myLabyrinthRoomData[];
+    static const RawData myLevelRawData[];
+    static const room_data_t mySnapshotProps;
     static const std::string myCornerStyles[][2];
     static const std::string myLineStyles[][2];
     static const std::string mySpecialSymbols[];
+    static const std::string myMinimapSymbols[];
     static const std::string myMessages[WorldMessage::MAX];
+};
+
 
-    ITerminal * myTerminal = nullptr;
+// Class managing the "world", a set of rooms with various properties, held in the given storage policy.
+// Several players may play the same world from their own threads: each one only calls in with its own index.
+// What they share is kept in atomics: their positions, and masks of the keys found and the locks opened.
+template<typename Storage>
+class BasicWorld : public WorldBase
+{
+public:
+    using cell_t = typename Storage::cell_t;
+
+    BasicWorld(ITerminal * terminal);
+    BasicWorld(ITerminal * terminal, const RawData & rawData);
+
+    void load(const RawData & rawData);
+
+    // Players join at the start position, possibly while others are already playing.
+    int addPlayer(ITerminal * terminal);
+
+    void render(int player = LOCAL_PLAYER) const;
+    void renderRoom(int x, int y, int player = LOCAL_PLAYER) const;
+    void renderSelectedRoom(int player = LOCAL_PLAYER) const;
+    void renderDamage(int player = LOCAL_PLAYER);
+
+    // Shows what the player senses in their current room, as move() does after each step.
+    void displayPercept(int player = LOCAL_PLAYER) const;
+
+    void moveSelection(MoveDirection direction, int player = LOCAL_PLAYER);
+    void move(int player = LOCAL_PLAYER);
+    void toggleWumpus(int player = LOCAL_PLAYER);
+    void toggleUnknown(int player = LOCAL_PLAYER);
+
+    int getPlayerCount() const
+    {
+        return myPlayerCount.load(std::memory_order_acquire);
+    }
+
+    bool isGameOver(int player = LOCAL_PLAYER) const
+    {
+        return myPlayers[player]->gameOver;
+    }
+
+    bool isWon(int player = LOCAL_PLAYER) const
+    {
+        return myPlayers[player]->won;
+    }
+
+    bool isTreasureReachable(int player = LOCAL_PLAYER) const
+    {
+        return isTreasureReachable(myPlayers[player]->currX, myPlayers[player]->currY, getKeys());
+    }
+
+    bool isTreasureReachable(int x, int y, key_mask_t keys) const;
+
+    void setFinalLevel(bool finalLevel)
+    {
+        myFinalLevel = finalLevel;
+    }
+
+    void setBroadcaster(SpectatorBroadcaster * broadcaster)
+    {
+        myBroadcaster = broadcaster;
+    }
+
+    // Percepts and visible layout, i.e. what the player can see on screen.
+    int getWidth() const
+    {
+        return myWidth;
+    }
+
+    int getHeight() const
+    {
+        return myHeight;
+    }
+
+    int getCurrX(int player = LOCAL_PLAYER) const
+    {
+        return myPlayers[player]->currX;
+    }
+
+    int getCurrY(int player = LOCAL_PLAYER) const
+    {
+        return myPlayers[player]->currY;
+    }
+
+    // Keys are shared: once found by a player, any player may open the matching lock.
+    key_mask_t getKeys() const
+    {
+        return myKeys.load(std::memory_order_acquire);
+    }
+
+    bool isRoomValid(int x, int y) const
+    {
+        return (x >= 0) && (x < myWidth) && (y >= 0) && (y < myHeight) && (myRooms.at(x, y) & RoomProp::VALID);
+    }
+
+    bool isRoomLocked(int x, int y) const
+    {
+        int lockId = isRoomValid(x, y) ? getLockId(y * myWidth + x) : -1;
+        return (lockId >= 0) && !(myUnlocked.load(std::memory_order_acquire) & (key_mask_t(1) << lockId));
+    }
+
+    bool isNearWumpus(int player = LOCAL_PLAYER) const;
+    void setSelection(int x, int y, int player = LOCAL_PLAYER);
+
+    void dumpRawData();
+
+    void saveSnapshot(std::ostream & os) const;
+    bool restoreSnapshot(std::istream & is);
+
+private:
+    using Kernel = bool[3][3];
+
+    // State owned by a single player; other players' threads only read the published room and write the damage.
+    struct PlayerState
+    {
+        ITerminal * terminal = nullptr;
+        int currX = 0;
+        int currY = 0;
+        int selectX = 0;
+        int selectY = 0;
+        int viewX = 0;
+        int viewY = 0;
+        std::atomic<int> room{0}; // (currY * width + currX), published for other players' rendering.
+        bool gameOver = false;
+        bool won = false;
+        std::unordered_map<int, room_data_t> overlay; // MARK_WUMPUS, MARK_UNKNOWN and VISITED, for rooms with any.
+        boost::mutex damageMutex;
+        std::vector<int> damage; // Rooms to redraw since other players moved.
+    };
+
+    void resetPlayer(PlayerState & state) const;
+    bool scrollToSelection(PlayerState & state) const;
+    void clearView(int player) const;
+    void updateSelection(int oldX, int oldY, int player);
+    void addDamage(int x, int y, int player);
+    void buildReachIndex();
+    void updateKernel(int x, int y, Kernel & kernel) const;
+    std::string getCornerStyle(const Kernel & kernel, int xKernel, int yKernel, int drawStyle) const;
+    std::string getRoomContent(int x, int y, int player) const;
+    void displayMessage(const std::string & message, int messageLine, int player) const;
+    void broadcast(int x, int y, const std::string & text) const;
+    uint8_t getMinimapProps(int x, int y) const;
+    void buildMinimap();
+    void updateMinimap(int x, int y);
+    void renderMinimap() const;
+    void renderMinimapCell(int x, int y) const;
+
+    // Keys and locks are few, so only their rooms are kept, sorted; a key or lock id is its index in the list.
+    static int findRoomId(const std::vector<int> & rooms, int room)
+    {
+        auto it = std::lower_bound(rooms.begin(), rooms.end(), room);
+        return ((it != rooms.end()) && (*it == room)) ? static_cast<int>(it - rooms.begin()) : -1;
+    }
+
+    int getKeyId(int room) const
+    {
+        return findRoomId(myKeyRooms, room);
+    }
+
+    int getLockId(int room) const
+    {
+        return findRoomId(myLockRooms, room);
+    }
+
+    int getViewWidth() const
+    {
+        return std::min(myWidth, VIEW_COLUMNS);
+    }
+
+    int getViewHeight() const
+    {
+        return std::min(myHeight, VIEW_ROWS);
+    }
+
+    bool isInView(const PlayerState & state, int x, int y) const
+    {
+        return (x >= state.viewX) && (x < state.viewX + getViewWidth()) &&
+            (y >= state.viewY) && (y < state.viewY + getViewHeight());
+    }
+
+    int getMinimapLeft() const
+    {
+        return (getViewWidth() * 4) + 3;
+    }
+
+    bool isOtherPlayerIn(int room, int player) const
+    {
+        for (int other = 0; other < getPlayerCount(); ++other)
+        {
+            if ((other != player) && (myPlayers[other]->room.load(std::memory_order_acquire) == room))
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    room_data_t getOverlay(int x, int y, int player) const
+    {
+        auto it = myPlayers[player]->overlay.find(y * myWidth + x);
+        return (it != myPlayers[player]->overlay.end()) ? it->second : 0;
+    }
+
+    SpectatorBroadcaster * myBroadcaster = nullptr;
     int myWidth = 0;
     int myHeight = 0;
-    int myCurrX = 0;
-    int myCurrY = 0;
-    int mySelectX = 0;
-    int mySelectY = 0;
-    bool myGameOver = false;
-    std::unique_ptr<room_data_t[]> myRoomData;
-    std::unique_ptr<room_data_t*[]> myRoomGrid;
-    mutable bool myKernel[3][3];
+    int myStartX = 0;
+    int myStartY = 0;
+    bool myFinalLevel = true;
+    uint64_t myBaseHash = 0;
+    int myKeyCount = 0;
+    std::atomic<key_mask_t> myKeys{0};
+    std::atomic<key_mask_t> myUnlocked{0};
+    std::vector<int> myKeyRooms;
+    std::vector<int> myLockRooms;
+    std::vector<uint64_t> myReachIndex;
+    boost::mutex myJoinMutex;
+    std::atomic<int> myPlayerCount{0};
+    std::array<std::unique_ptr<PlayerState>, MAX_PLAYERS> myPlayers;
+    Storage myRooms;
+    Minimap myMinimap;
 };
 
+using World = BasicWorld<WorldStorage>;
+
 #endif // WORLD_H
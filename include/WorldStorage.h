@@ -0,0 +1,99 @@
+﻿#ifndef WORLD_STORAGE_H
+#define WORLD_STORAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <type_traits>
+
+
+// Storage policies for the room grid of a World, selected at compile time.
+// Each provides cell_t, resize(width, height) (zero filling all cells) and at(x, y).
+
+// Flat row-major storage.
+template<typename Cell>
+class RowMajorStorage
+{
+public:
+    using cell_t = Cell;
+
+    static_assert(std::is_unsigned<Cell>::value && (std::numeric_limits<Cell>::digits >= 8),
+        "Room cells must be unsigned and hold at least 8 flag bits");
+
+    void resize(int width, int height)
+    {
+        myWidth = width;
+        myCells = std::make_unique<Cell[]>(static_cast<std::size_t>(width) * height);
+    }
+
+    Cell & at(int x, int y)
+    {
+        return myCells[static_cast<std::size_t>(y) * myWidth + x];
+    }
+
+    const Cell & at(int x, int y) const
+    {
+        return myCells[static_cast<std::size_t>(y) * myWidth + x];
+    }
+
+private:
+    int myWidth = 0;
+    std::unique_ptr<Cell[]> myCells;
+};
+
+// Tiled storage: square tiles of (1 << TileBits) rooms per side laid out row-major, with rooms in Z-order
+// (Morton order) inside each tile. With the default 8x8 tiles of uint8_t cells, a tile fills one cache line,
+// so the 3x3 neighborhood of a room usually touches one or two lines rather than three rows.
+template<typename Cell, int TileBits = 3>
+class TiledStorage
+{
+public:
+    using cell_t = Cell;
+
+    static_assert(std::is_unsigned<Cell>::value && (std::numeric_limits<Cell>::digits >= 8),
+        "Room cells must be unsigned and hold at least 8 flag bits");
+    static_assert((TileBits > 0) && (TileBits <= 8), "Tile size must be between 2 and 256");
+
+    void resize(int width, int height)
+    {
+        int tileSize = 1 << TileBits;
+        myTilesPerRow = (width + tileSize - 1) >> TileBits;
+        int tileRows = (height + tileSize - 1) >> TileBits;
+        myCells = std::make_unique<Cell[]>(static_cast<std::size_t>(myTilesPerRow) * tileRows << (TileBits * 2));
+    }
+
+    Cell & at(int x, int y)
+    {
+        return myCells[getIndex(x, y)];
+    }
+
+    const Cell & at(int x, int y) const
+    {
+        return myCells[getIndex(x, y)];
+    }
+
+private:
+    static constexpr int TILE_MASK = (1 << TileBits) - 1;
+
+    // Spread the low 8 bits of a value out to the even bits.
+    static std::size_t spreadBits(unsigned value)
+    {
+        value &= 0xFF;
+        value = (value | (value << 4)) & 0x0F0F;
+        value = (value | (value << 2)) & 0x3333;
+        value = (value | (value << 1)) & 0x5555;
+        return value;
+    }
+
+    std::size_t getIndex(int x, int y) const
+    {
+        std::size_t tile = static_cast<std::size_t>(y >> TileBits) * myTilesPerRow + (x >> TileBits);
+        return (tile << (TileBits * 2)) | spreadBits(x & TILE_MASK) | (spreadBits(y & TILE_MASK) << 1);
+    }
+
+    int myTilesPerRow = 0;
+    std::unique_ptr<Cell[]> myCells;
+};
+
+#endif // WORLD_STORAGE_H
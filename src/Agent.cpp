@@ -0,0 +1,207 @@
+﻿#include "Agent.h"
+
+#include <cstdlib>
+#include <deque>
+#include <limits>
+
+namespace
+{
+    const int DX[] = {0, 0, -1, 1};
+    const int DY[] = {-1, 1, 0, 0};
+    const World::MoveDirection DIRECTIONS[] = {
+        World::MoveDirection::up,
+        World::MoveDirection::down,
+        World::MoveDirection::left,
+        World::MoveDirection::right
+    };
+}
+
+
+void RandomAgent::reset(const World &, uint32_t seed)
+{
+    myRng.seed(seed);
+}
+
+World::MoveDirection RandomAgent::chooseMove(const World & world, int player)
+{
+    World::MoveDirection choices[4];
+    int choiceCount = 0;
+
+    for (int i = 0; i < 4; ++i)
+    {
+        if (world.isRoomValid(world.getCurrX(player) + DX[i], world.getCurrY(player) + DY[i]))
+        {
+            choices[choiceCount++] = DIRECTIONS[i];
+        }
+    }
+
+    if (choiceCount == 0)
+    {
+        return World::MoveDirection::up;
+    }
+
+    return choices[std::uniform_int_distribution<int>(0, choiceCount - 1)(myRng)];
+}
+
+
+void CautiousAgent::reset(const World & world, uint32_t seed)
+{
+    myWidth = world.getWidth();
+    myHeight = world.getHeight();
+    myLastRoom = -1;
+    myLastTarget = -1;
+    myLastKeys = 0;
+    myPercepts.assign(myWidth * myHeight, UNKNOWN);
+    myBlocked.assign(myWidth * myHeight, false);
+    myRng.seed(seed);
+}
+
+World::MoveDirection CautiousAgent::chooseMove(const World & world, int player)
+{
+    int room = world.getCurrY(player) * myWidth + world.getCurrX(player);
+    myPercepts[room] = world.isNearWumpus(player) ? NEAR : CLEAR;
+
+    // A move into a locked room is rejected; avoid it until another key turns up.
+    if (world.getKeys() != myLastKeys)
+    {
+        myBlocked.assign(myBlocked.size(), false);
+        myLastKeys = world.getKeys();
+    }
+    else if ((room == myLastRoom) && (myLastTarget >= 0) && world.isRoomLocked(myLastTarget % myWidth,
+        myLastTarget / myWidth))
+    {
+        myBlocked[myLastTarget] = true;
+    }
+
+    myLastRoom = room;
+    myLastTarget = chooseTarget(world, player);
+    return getFirstStep(world, player, myLastTarget);
+}
+
+int CautiousAgent::chooseTarget(const World & world, int player)
+{
+    // Score each unexplored room bordering the explored area: rooms next to a clear percept are safe, otherwise
+    // prefer the fewest neighboring "near" percepts, then the shortest walk.
+    int bestTarget = -1;
+    double bestRisk = std::numeric_limits<double>::max();
+    int bestTies = 0;
+
+    for (int y = 0; y < myHeight; ++y)
+    {
+        for (int x = 0; x < myWidth; ++x)
+        {
+            int room = y * myWidth + x;
+
+            if (!world.isRoomValid(x, y) || (myPercepts[room] != UNKNOWN) || myBlocked[room])
+            {
+                continue;
+            }
+
+            int nearCount = 0;
+            int knownCount = 0;
+            bool safe = false;
+
+            for (int i = 0; i < 4; ++i)
+            {
+                int nx = x + DX[i];
+                int ny = y + DY[i];
+
+                if (!world.isRoomValid(nx, ny) || (myPercepts[ny * myWidth + nx] == UNKNOWN))
+                {
+                    continue;
+                }
+
+                ++knownCount;
+
+                if (myPercepts[ny * myWidth + nx] == CLEAR)
+                {
+                    safe = true;
+                }
+                else
+                {
+                    ++nearCount;
+                }
+            }
+
+            if (knownCount == 0)
+            {
+                continue;
+            }
+
+            double risk = safe ? 0.0 : static_cast<double>(nearCount) / knownCount;
+            risk += (std::abs(x - world.getCurrX(player)) + std::abs(y - world.getCurrY(player))) * 1e-6;
+
+            // Break exact ties uniformly at random.
+            if (risk < bestRisk)
+            {
+                bestRisk = risk;
+                bestTarget = room;
+                bestTies = 1;
+            }
+            else if ((risk == bestRisk) && (std::uniform_int_distribution<int>(0, bestTies++)(myRng) == 0))
+            {
+                bestTarget = room;
+            }
+        }
+    }
+
+    return bestTarget;
+}
+
+World::MoveDirection CautiousAgent::getFirstStep(const World & world, int player, int target) const
+{
+    int start = world.getCurrY(player) * myWidth + world.getCurrX(player);
+
+    if (target < 0)
+    {
+        return World::MoveDirection::up;
+    }
+
+    // Breadth-first search back from the target through explored rooms, which are always safe to cross.
+    std::vector<int> next(myWidth * myHeight, -1);
+    std::deque<int> queue;
+    next[target] = target;
+    queue.push_back(target);
+
+    while (!queue.empty())
+    {
+        int room = queue.front();
+        queue.pop_front();
+
+        if (room == start)
+        {
+            break;
+        }
+
+        for (int i = 0; i < 4; ++i)
+        {
+            int nx = room % myWidth + DX[i];
+            int ny = room / myWidth + DY[i];
+            int neighbor = ny * myWidth + nx;
+
+            if (world.isRoomValid(nx, ny) && (next[neighbor] < 0) && (myPercepts[neighbor] != UNKNOWN))
+            {
+                next[neighbor] = room;
+                queue.push_back(neighbor);
+            }
+        }
+    }
+
+    int step = next[start];
+
+    if (step < 0)
+    {
+        return World::MoveDirection::up;
+    }
+
+    for (int i = 0; i < 4; ++i)
+    {
+        if ((world.getCurrX(player) + DX[i] == step % myWidth) &&
+            (world.getCurrY(player) + DY[i] == step / myWidth))
+        {
+            return DIRECTIONS[i];
+        }
+    }
+
+    return World::MoveDirection::up;
+}
@@ -1,8 +1,12 @@
 ﻿#include "Game.h"
 
-#include <boost/thread/thread.hpp>
-#include <boost/date_time/posix_time/posix_time.hpp>
+#include "Snapshot.h"
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 #include <stdexcept>
+#include <unistd.h>
 
 
 const std::string Game::myBanner = R"(
@@ -18,11 +22,25 @@ const std::string Game::myMessages[GameMessage::MAX] = {
     "                       ---  Press enter to start! ---                           ",
 };
 
+const boost::posix_time::time_duration Game::mySnapshotInterval = boost::posix_time::seconds(5);
+const boost::posix_time::time_duration Game::myTelemetryInterval = boost::posix_time::seconds(10);
 
-Game::Game() :
+
+Game::Game(const std::string & player) :
+    mySnapshotPath(getSnapshotPath(player)),
+    myTelemetry(getTelemetryPath(), std::to_string(getpid()), myTelemetryInterval),
     myTerminal(std::make_unique<OSTerminal>()),
-    myActiveWorld(myTerminal.get())
+    myActiveWorld(std::make_unique<World>(myTerminal.get(), World::getLevelRawData(0)))
 {
+    myActiveWorld->setFinalLevel(World::getLevelCount() == 1);
+}
+
+Game::~Game()
+{
+    if (myPreloadThread.joinable())
+    {
+        myPreloadThread.join();
+    }
 }
 
 void Game::initialize()
@@ -32,6 +50,25 @@ void Game::initialize()
 
     if (!myTerminal->setMode(eTermMode::TM_GAME))
         throw std::runtime_error("Terminal setMode failed");
+
+    // Spectating is optional, so play on without it if shared memory is unavailable.
+    try
+    {
+        myBroadcaster = std::make_unique<SpectatorBroadcaster>(SpectatorBroadcaster::getName(getpid()));
+    }
+    catch (boost::interprocess::interprocess_exception &)
+    {
+    }
+
+    // Resume an in-progress game if one was saved.
+    if (restoreSnapshot())
+    {
+        updateState(GameState::game);
+    }
+
+    myActiveWorld->setBroadcaster(myBroadcaster.get());
+
+    preloadLevel(myLevel + 1);
 }
 
 void Game::executiveLoop()
@@ -56,6 +93,11 @@ void Game::executiveLoop()
             throw std::runtime_error("Unexpected game state");
         }
 
+        if (myBroadcaster)
+        {
+            myBroadcaster->flush();
+        }
+
         boost::this_thread::sleep(boost::posix_time::millisec(10));
     }
 }
@@ -64,6 +106,15 @@ void Game::updateState(const GameState gameState)
 {
     myGameState = gameState;
     myStateInit = true;
+
+    if (gameState == GameState::game)
+    {
+        Telemetry::increment(Metric::GAMES_STARTED);
+    }
+    else if (gameState == GameState::gameover)
+    {
+        Telemetry::increment(myActiveWorld->isWon() ? Metric::GAMES_WON : Metric::GAMES_LOST);
+    }
 }
 
 void Game::processSplash()
@@ -75,6 +126,12 @@ void Game::processSplash()
         myTerminal->output(myBanner);
         myTerminal->setCursorPos(0, 14);
         myTerminal->output(myMessages[GameMessage::START]);
+
+        if (myBroadcaster)
+        {
+            myTerminal->setCursorPos(0, 16);
+            myTerminal->output("                   Spectate with: wumpus --spectate " + std::to_string(getpid()));
+        }
     }
 
     kb_codes_vec kbCodes;
@@ -101,55 +158,85 @@ void Game::processGame()
     {
         myStateInit = false;
         myTerminal->clearScreen();
-        myActiveWorld.render();
+
+        if (myBroadcaster)
+        {
+            myBroadcaster->clear();
+        }
+
+        myActiveWorld->render();
+
+        // The start room may already be next to a wumpus, and the player must be told before the first move.
+        myActiveWorld->displayPercept();
     }
 
     kb_codes_vec kbCodes;
 
     if (myTerminal->pollKeys(kbCodes))
     {
+        mySnapshotDirty = true;
+
         switch (kbCodes[0])
         {
         case KB_UP:
-            myActiveWorld.moveSelection(World::MoveDirection::up);
+            myActiveWorld->moveSelection(World::MoveDirection::up);
             break;
 
         case KB_DOWN:
-            myActiveWorld.moveSelection(World::MoveDirection::down);
+            myActiveWorld->moveSelection(World::MoveDirection::down);
             break;
 
         case KB_LEFT:
-            myActiveWorld.moveSelection(World::MoveDirection::left);
+            myActiveWorld->moveSelection(World::MoveDirection::left);
             break;
 
         case KB_RIGHT:
-            myActiveWorld.moveSelection(World::MoveDirection::right);
+            myActiveWorld->moveSelection(World::MoveDirection::right);
             break;
 
         case KB_SPACE:
         case KB_ENTER:
-            myActiveWorld.move();
+            myActiveWorld->move();
             break;
 
         case KB_W:
-            myActiveWorld.toggleWumpus();
+            myActiveWorld->toggleWumpus();
             break;
 
         case KB_U:
-            myActiveWorld.toggleUnknown();
+            myActiveWorld->toggleUnknown();
             break;
 
         case KB_Q:
         case KB_ESCAPE:
+            saveSnapshot();
             myExiting = true;
             break;
         }
     }
 
-    if (myActiveWorld.isGameOver())
+    // Redraw the rooms other players have moved through since the last iteration.
+    myActiveWorld->renderDamage();
+
+    if (myActiveWorld->isGameOver())
     {
+        // Keep a won level saved until the player moves on, so dropping out here doesn't lose the campaign.
+        if (myActiveWorld->isWon() && (myLevel + 1 < World::getLevelCount()))
+        {
+            saveSnapshot();
+        }
+        else
+        {
+            removeSnapshot();
+        }
+
         updateState(GameState::gameover);
     }
+    else if (mySnapshotDirty &&
+        (boost::posix_time::microsec_clock::universal_time() - myLastSnapshotTime >= mySnapshotInterval))
+    {
+        saveSnapshot();
+    }
 }
 
 void Game::processGameOver()
@@ -167,9 +254,165 @@ void Game::processGameOver()
             // Ignore arrow keys to minimize chance user exits without noticing the game over message.
             break;
 
-        default:
+        case KB_Q:
+        case KB_ESCAPE:
+            // Quit without advancing, keeping a won level saved so the campaign can be resumed from the next one.
+            if (myActiveWorld->isWon() && (myLevel + 1 < World::getLevelCount()))
+            {
+                saveSnapshot();
+            }
+
             myExiting = true;
             break;
+
+        default:
+            if (myActiveWorld->isWon() && advanceLevel())
+            {
+                updateState(GameState::game);
+            }
+            else
+            {
+                myExiting = true;
+            }
+            break;
+        }
+    }
+}
+
+void Game::preloadLevel(int level)
+{
+    if (level >= World::getLevelCount())
+    {
+        return;
+    }
+
+    // Load the next world in the background, including its reachability index and minimap pyramid, so the
+    // transition only costs a frame. Room borders are computed while drawing, so there is no render cache to build.
+    myPreloadThread = boost::thread([this, level]() {
+        auto world = std::make_unique<World>(myTerminal.get(), World::getLevelRawData(level));
+        world->setFinalLevel(level == World::getLevelCount() - 1);
+        myNextWorld = std::move(world);
+    });
+}
+
+bool Game::advanceLevel()
+{
+    if (myPreloadThread.joinable())
+    {
+        myPreloadThread.join();
+    }
+
+    if (!myNextWorld)
+    {
+        return false;
+    }
+
+    myActiveWorld = std::move(myNextWorld);
+    myActiveWorld->setBroadcaster(myBroadcaster.get());
+    ++myLevel;
+    preloadLevel(myLevel + 1);
+    saveSnapshot();
+    return true;
+}
+
+void Game::saveSnapshot()
+{
+    // Write to a temporary file and rename it over the old snapshot, so a crash mid-write can't corrupt it.
+    std::string tempPath = mySnapshotPath + ".tmp";
+
+    {
+        std::ofstream ofs(tempPath, std::ios::binary | std::ios::trunc);
+        Snapshot::write(ofs, Snapshot::MAGIC);
+        Snapshot::write(ofs, Snapshot::VERSION);
+        Snapshot::write(ofs, static_cast<uint16_t>(myLevel));
+        myActiveWorld->saveSnapshot(ofs);
+
+        if (!ofs.flush())
+        {
+            return;
         }
     }
+
+    if (std::rename(tempPath.c_str(), mySnapshotPath.c_str()) == 0)
+    {
+        mySnapshotDirty = false;
+        myLastSnapshotTime = boost::posix_time::microsec_clock::universal_time();
+    }
+}
+
+bool Game::restoreSnapshot()
+{
+    std::ifstream ifs(mySnapshotPath, std::ios::binary);
+    uint32_t magic;
+    uint16_t version;
+    uint16_t level;
+
+    if (!Snapshot::read(ifs, magic) || (magic != Snapshot::MAGIC) ||
+        !Snapshot::read(ifs, version) || (version != Snapshot::VERSION) ||
+        !Snapshot::read(ifs, level) || (level >= World::getLevelCount()))
+    {
+        return false;
+    }
+
+    // The snapshot only holds the player overlay, so start from a freshly loaded copy of its level.
+    auto world = std::make_unique<World>(myTerminal.get(), World::getLevelRawData(level));
+    world->setFinalLevel(level == World::getLevelCount() - 1);
+
+    if (!world->restoreSnapshot(ifs))
+    {
+        return false;
+    }
+
+    // A level saved as won resumes at the start of the next one.
+    if (world->isGameOver())
+    {
+        if (!world->isWon() || (level + 1 >= World::getLevelCount()))
+        {
+            return false;
+        }
+
+        ++level;
+        world = std::make_unique<World>(myTerminal.get(), World::getLevelRawData(level));
+        world->setFinalLevel(level == World::getLevelCount() - 1);
+    }
+
+    myActiveWorld = std::move(world);
+    myLevel = level;
+    myLastSnapshotTime = boost::posix_time::microsec_clock::universal_time();
+    return true;
+}
+
+std::string Game::getSnapshotPath(const std::string & player)
+{
+    // Saves are kept per player, with the name reduced to characters that are safe in a file name.
+    std::string name = player.empty() ? "player" : player;
+
+    for (char & c : name)
+    {
+        if (!std::isalnum(static_cast<unsigned char>(c)) && (c != '-') && (c != '_'))
+        {
+            c = '_';
+        }
+    }
+
+    return "wumpus-" + name + ".sav";
+}
+
+std::string Game::getTelemetryPath()
+{
+    // Telemetry is only exported when WUMPUS_TELEMETRY_DIR names a directory, e.g. that of a textfile collector.
+    // Each process exports its own file there, as many sessions may run on one host.
+    const char * directory = std::getenv("WUMPUS_TELEMETRY_DIR");
+
+    if (!directory || !*directory)
+    {
+        return std::string();
+    }
+
+    return std::string(directory) + "/wumpus-" + std::to_string(getpid()) + ".prom";
+}
+
+void Game::removeSnapshot()
+{
+    std::remove(mySnapshotPath.c_str());
 }
@@ -0,0 +1,91 @@
+﻿#include "Minimap.h"
+
+
+void Minimap::resize(int width, int height, int maxColumns, int maxRows, room_props_t roomProps)
+{
+    // Level 0 only records its size; its cells are the rooms.
+    myRoomProps = std::move(roomProps);
+    myLevels.clear();
+    myLevels.push_back({width, height, std::vector<uint8_t>()});
+
+    while ((myLevels.back().width > 1) || (myLevels.back().height > 1))
+    {
+        int levelWidth = (myLevels.back().width + 1) / 2;
+        int levelHeight = (myLevels.back().height + 1) / 2;
+        myLevels.push_back({levelWidth, levelHeight, std::vector<uint8_t>(levelWidth * levelHeight, 0)});
+    }
+
+    // Display the finest level that fits the panel.
+    myDisplayLevel = 0;
+
+    while ((myDisplayLevel < static_cast<int>(myLevels.size()) - 1) &&
+        ((myLevels[myDisplayLevel].width > maxColumns) || (myLevels[myDisplayLevel].height > maxRows)))
+    {
+        ++myDisplayLevel;
+    }
+}
+
+void Minimap::buildLevels()
+{
+    for (std::size_t levelIndex = 1; levelIndex < myLevels.size(); ++levelIndex)
+    {
+        Level & level = myLevels[levelIndex];
+
+        for (int y = 0; y < level.height; ++y)
+        {
+            for (int x = 0; x < level.width; ++x)
+            {
+                level.cells[y * level.width + x] = reduce(levelIndex, x, y);
+            }
+        }
+    }
+}
+
+// Returns whether the displayed cell covering the room may have changed. The room's previous state isn't stored,
+// so a change is assumed when the rooms themselves are displayed.
+bool Minimap::update(int x, int y)
+{
+    for (std::size_t levelIndex = 1; levelIndex < myLevels.size(); ++levelIndex)
+    {
+        x >>= 1;
+        y >>= 1;
+
+        Level & level = myLevels[levelIndex];
+        uint8_t summary = reduce(levelIndex, x, y);
+
+        // Ancestors of an unchanged summary are unchanged too.
+        if (level.cells[y * level.width + x] == summary)
+        {
+            return myDisplayLevel < static_cast<int>(levelIndex);
+        }
+
+        level.cells[y * level.width + x] = summary;
+    }
+
+    return true;
+}
+
+uint8_t Minimap::reduce(int levelIndex, int x, int y) const
+{
+    const Level & child = myLevels[levelIndex - 1];
+    int childX = x * 2;
+    int childY = y * 2;
+    uint8_t summary = getCell(levelIndex - 1, childX, childY);
+
+    if (childX + 1 < child.width)
+    {
+        summary |= getCell(levelIndex - 1, childX + 1, childY);
+    }
+
+    if (childY + 1 < child.height)
+    {
+        summary |= getCell(levelIndex - 1, childX, childY + 1);
+
+        if (childX + 1 < child.width)
+        {
+            summary |= getCell(levelIndex - 1, childX + 1, childY + 1);
+        }
+    }
+
+    return summary;
+}
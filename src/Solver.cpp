@@ -0,0 +1,544 @@
+﻿#include "Solver.h"
+
+#include <algorithm>
+#include <boost/thread/thread.hpp>
+#include <numeric>
+#include <stdexcept>
+
+using namespace RoomProp;
+
+
+Solver::RoomSet & Solver::RoomSet::operator|=(const RoomSet & other)
+{
+    for (std::size_t i = 0; i < words.size(); ++i)
+    {
+        words[i] |= other.words[i];
+    }
+
+    return *this;
+}
+
+bool Solver::RoomSet::intersects(const RoomSet & other) const
+{
+    for (std::size_t i = 0; i < words.size(); ++i)
+    {
+        if (words[i] & other.words[i])
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool Solver::RoomSet::operator==(const RoomSet & other) const
+{
+    return words == other.words;
+}
+
+bool Solver::RoomSet::operator<(const RoomSet & other) const
+{
+    return words < other.words;
+}
+
+template<typename Func>
+void Solver::RoomSet::forEach(Func func) const
+{
+    for (std::size_t i = 0; i < words.size(); ++i)
+    {
+        uint64_t word = words[i];
+
+        while (word)
+        {
+            func(static_cast<int>(i * 64) + __builtin_ctzll(word));
+            word &= word - 1;
+        }
+    }
+}
+
+std::size_t Solver::StateKeyHash::operator()(const StateKey & key) const
+{
+    uint64_t hash = 0x9e3779b97f4a7c15ull;
+
+    auto mix = [&hash](uint64_t word) {
+        hash ^= word + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+        hash *= 0xff51afd7ed558ccdull;
+        hash ^= hash >> 33;
+    };
+
+    for (uint64_t word : key.visited.words)
+    {
+        mix(word);
+    }
+
+    for (uint64_t word : key.near.words)
+    {
+        mix(word);
+    }
+
+    return static_cast<std::size_t>(hash);
+}
+
+
+Solver::Solver(const World::RawData & rawData, int threadCount, std::size_t maxHypotheses) :
+    myWidth(rawData.width),
+    myHeight(rawData.height),
+    myStartRoom(rawData.startY * rawData.width + rawData.startX),
+    myThreadCount(threadCount)
+{
+    if (myWidth * myHeight > MAX_ROOMS)
+        throw std::runtime_error("World too large to solve exactly");
+
+    if (myThreadCount <= 0)
+    {
+        myThreadCount = std::max(1u, boost::thread::hardware_concurrency());
+    }
+
+    // Build adjacency between valid rooms, matching the movement rules in World::move.
+    myNeighbors.resize(myWidth * myHeight);
+
+    for (int y = 0; y < myHeight; ++y)
+    {
+        for (int x = 0; x < myWidth; ++x)
+        {
+            int room = y * myWidth + x;
+
+            if (rawData.data[room] & TREASURE)
+            {
+                myTreasureRoom = room;
+            }
+
+            const int dx[] = {0, 0, -1, 1};
+            const int dy[] = {-1, 1, 0, 0};
+
+            for (int i = 0; i < 4; ++i)
+            {
+                int nx = x + dx[i];
+                int ny = y + dy[i];
+
+                if ((nx >= 0) && (nx < myWidth) && (ny >= 0) && (ny < myHeight) &&
+                    (rawData.data[ny * myWidth + nx] & VALID))
+                {
+                    myNeighbors[room].set(ny * myWidth + nx);
+                }
+            }
+        }
+    }
+
+    // Pair keys with locked rooms the same way World does: the n-th key opens the n-th locked room.
+    std::vector<int> keys;
+    std::vector<int> locks;
+    myKeyRooms.assign(myWidth * myHeight, NO_LOCK);
+
+    for (int room = 0; room < myWidth * myHeight; ++room)
+    {
+        if (rawData.data[room] & KEY)
+        {
+            keys.push_back(room);
+        }
+
+        if (rawData.data[room] & LOCKED)
+        {
+            locks.push_back(room);
+        }
+    }
+
+    for (std::size_t i = 0; i < locks.size(); ++i)
+    {
+        myKeyRooms[locks[i]] = (i < keys.size()) ? keys[i] : NO_KEY;
+    }
+
+    buildHypotheses(rawData, maxHypotheses);
+    buildSymmetries(rawData);
+}
+
+double Solver::solve()
+{
+    if (myTreasureRoom < 0)
+    {
+        return 0.0;
+    }
+
+    if (myStartRoom == myTreasureRoom)
+    {
+        return 1.0;
+    }
+
+    // Entering the start room splits the hypotheses by the percept seen there, shown by World as the level starts.
+    // The candidate moves of each resulting decision node form the root branches, searched in parallel.
+    struct RootNode
+    {
+        RoomSet visited;
+        RoomSet near;
+        hypothesis_list_t hyps;
+        std::vector<int> moves;
+        std::vector<double> values;
+        bool win = false;
+    };
+
+    RootNode rootNodes[2];
+    rootNodes[0].visited.set(myStartRoom);
+    rootNodes[1].visited.set(myStartRoom);
+    rootNodes[1].near.set(myStartRoom);
+
+    for (uint32_t i = 0; i < myHypotheses.size(); ++i)
+    {
+        rootNodes[myHypotheses[i].near.test(myStartRoom) ? 1 : 0].hyps.push_back(i);
+    }
+
+    std::vector<std::pair<int, int>> tasks;
+
+    for (int node = 0; node < 2; ++node)
+    {
+        RootNode & rootNode = rootNodes[node];
+
+        if (rootNode.hyps.empty())
+        {
+            continue;
+        }
+
+        rootNode.win = getCandidateMoves(rootNode.visited, rootNode.hyps, rootNode.moves);
+
+        if (!rootNode.win)
+        {
+            rootNode.values.resize(rootNode.moves.size(), 0.0);
+
+            for (int move = 0; move < static_cast<int>(rootNode.moves.size()); ++move)
+            {
+                tasks.emplace_back(node, move);
+            }
+        }
+    }
+
+    std::atomic<std::size_t> nextTask{0};
+    boost::thread_group workers;
+
+    for (int i = 0; i < std::min<int>(myThreadCount, tasks.size()); ++i)
+    {
+        workers.create_thread([&]() {
+            for (std::size_t task = nextTask++; task < tasks.size(); task = nextTask++)
+            {
+                RootNode & rootNode = rootNodes[tasks[task].first];
+                int move = tasks[task].second;
+                rootNode.values[move] = evaluateMove(rootNode.visited, rootNode.near, rootNode.hyps,
+                    rootNode.moves[move]);
+            }
+        });
+    }
+
+    workers.join_all();
+
+    double winWeight = 0.0;
+
+    for (const RootNode & rootNode : rootNodes)
+    {
+        if (rootNode.win)
+        {
+            winWeight += rootNode.hyps.size();
+        }
+        else if (!rootNode.values.empty())
+        {
+            winWeight += rootNode.hyps.size() * *std::max_element(rootNode.values.begin(), rootNode.values.end());
+        }
+    }
+
+    return winWeight / myHypotheses.size();
+}
+
+void Solver::buildHypotheses(const World::RawData & rawData, std::size_t maxHypotheses)
+{
+    std::vector<int> candidates;
+    int wumpusCount = 0;
+
+    for (int room = 0; room < myWidth * myHeight; ++room)
+    {
+        if (rawData.data[room] & WUMPUS)
+        {
+            ++wumpusCount;
+        }
+
+        if ((rawData.data[room] & VALID) && (room != myStartRoom) && (room != myTreasureRoom))
+        {
+            candidates.push_back(room);
+        }
+    }
+
+    int candidateCount = static_cast<int>(candidates.size());
+
+    if (wumpusCount > candidateCount)
+        throw std::runtime_error("World has more wumpuses than candidate rooms");
+
+    // Check the number of placements (n choose k) before enumerating them.
+    double placements = 1.0;
+
+    for (int i = 0; i < wumpusCount; ++i)
+    {
+        placements = placements * (candidateCount - i) / (i + 1);
+    }
+
+    if (placements > maxHypotheses)
+        throw std::runtime_error("Too many wumpus placements to solve exactly");
+
+    myHypotheses.reserve(static_cast<std::size_t>(placements + 0.5));
+
+    std::vector<int> indices(wumpusCount);
+    std::iota(indices.begin(), indices.end(), 0);
+
+    while (true)
+    {
+        Hypothesis hypothesis;
+
+        for (int index : indices)
+        {
+            hypothesis.wumpus.set(candidates[index]);
+            hypothesis.near |= myNeighbors[candidates[index]];
+        }
+
+        myHypotheses.push_back(hypothesis);
+
+        // Advance to the next combination in lexicographic order.
+        int i = wumpusCount - 1;
+
+        while ((i >= 0) && (indices[i] == candidateCount - wumpusCount + i))
+        {
+            --i;
+        }
+
+        if (i < 0)
+        {
+            break;
+        }
+
+        ++indices[i];
+
+        for (int j = i + 1; j < wumpusCount; ++j)
+        {
+            indices[j] = indices[j - 1] + 1;
+        }
+    }
+}
+
+void Solver::buildSymmetries(const World::RawData & rawData)
+{
+    // Candidate transforms: identity, flips, 180 degree rotation, plus transposes/90 degree rotations if square.
+    std::vector<std::pair<int, int> (*)(int, int, int, int)> transforms = {
+        [](int x, int y, int, int) { return std::make_pair(x, y); },
+        [](int x, int y, int w, int) { return std::make_pair(w - 1 - x, y); },
+        [](int x, int y, int, int h) { return std::make_pair(x, h - 1 - y); },
+        [](int x, int y, int w, int h) { return std::make_pair(w - 1 - x, h - 1 - y); }
+    };
+
+    if (myWidth == myHeight)
+    {
+        transforms.push_back([](int x, int y, int, int) { return std::make_pair(y, x); });
+        transforms.push_back([](int x, int y, int w, int h) { return std::make_pair(w - 1 - y, h - 1 - x); });
+        transforms.push_back([](int x, int y, int w, int) { return std::make_pair(w - 1 - y, x); });
+        transforms.push_back([](int x, int y, int, int h) { return std::make_pair(y, h - 1 - x); });
+    }
+
+    // Keep transforms preserving the room layout, key pairings, start and treasure; the wumpus prior is then
+    // invariant too.
+    for (auto transform : transforms)
+    {
+        std::vector<int> permutation(myWidth * myHeight);
+        bool symmetric = true;
+
+        for (int y = 0; (y < myHeight) && symmetric; ++y)
+        {
+            for (int x = 0; x < myWidth; ++x)
+            {
+                auto mapped = transform(x, y, myWidth, myHeight);
+                int room = y * myWidth + x;
+                int mappedRoom = mapped.second * myWidth + mapped.first;
+
+                if ((rawData.data[room] & (VALID | KEY | LOCKED)) !=
+                    (rawData.data[mappedRoom] & (VALID | KEY | LOCKED)))
+                {
+                    symmetric = false;
+                    break;
+                }
+
+                permutation[room] = mappedRoom;
+            }
+        }
+
+        for (int room = 0; (room < myWidth * myHeight) && symmetric; ++room)
+        {
+            int keyRoom = myKeyRooms[room];
+            int mappedKeyRoom = myKeyRooms[permutation[room]];
+            symmetric = (keyRoom < 0) ? (mappedKeyRoom == keyRoom) : (mappedKeyRoom == permutation[keyRoom]);
+        }
+
+        if (symmetric && (permutation[myStartRoom] == myStartRoom) &&
+            ((myTreasureRoom < 0) || (permutation[myTreasureRoom] == myTreasureRoom)))
+        {
+            mySymmetries.push_back(std::move(permutation));
+        }
+    }
+}
+
+bool Solver::isUnlocked(int room, const RoomSet & visited) const
+{
+    // The start room is always visited, matching World, which hands out a key there as the level begins.
+    int keyRoom = myKeyRooms[room];
+    return (keyRoom == NO_LOCK) || ((keyRoom >= 0) && visited.test(keyRoom));
+}
+
+Solver::StateKey Solver::getCanonicalKey(const RoomSet & visited, const RoomSet & near) const
+{
+    StateKey best{visited, near};
+
+    // The first symmetry is always the identity.
+    for (std::size_t i = 1; i < mySymmetries.size(); ++i)
+    {
+        const std::vector<int> & permutation = mySymmetries[i];
+        StateKey key;
+
+        visited.forEach([&](int room) { key.visited.set(permutation[room]); });
+        near.forEach([&](int room) { key.near.set(permutation[room]); });
+
+        if ((key.visited < best.visited) || ((key.visited == best.visited) && (key.near < best.near)))
+        {
+            best = key;
+        }
+    }
+
+    return best;
+}
+
+bool Solver::getCandidateMoves(const RoomSet & visited, const hypothesis_list_t & hyps, std::vector<int> & moves) const
+{
+    RoomSet frontier;
+    visited.forEach([&](int room) { frontier |= myNeighbors[room]; });
+
+    if ((myTreasureRoom >= 0) && frontier.test(myTreasureRoom) && !visited.test(myTreasureRoom) &&
+        isUnlocked(myTreasureRoom, visited))
+    {
+        return true;
+    }
+
+    RoomSet possibleWumpus;
+
+    for (uint32_t hyp : hyps)
+    {
+        possibleWumpus |= myHypotheses[hyp].wumpus;
+    }
+
+    moves.clear();
+
+    // Entering a room that is safe under every remaining hypothesis only adds information, so it dominates.
+    bool foundSafe = false;
+
+    frontier.forEach([&](int room) {
+        if (foundSafe || visited.test(room) || !isUnlocked(room, visited))
+        {
+            return;
+        }
+
+        if (!possibleWumpus.test(room))
+        {
+            moves.assign(1, room);
+            foundSafe = true;
+        }
+        else
+        {
+            moves.push_back(room);
+        }
+    });
+
+    return false;
+}
+
+double Solver::evaluate(const RoomSet & visited, const RoomSet & near, const hypothesis_list_t & hyps)
+{
+    StateKey key = getCanonicalKey(visited, near);
+    TableShard & shard = myTable[(StateKeyHash()(key) >> 32) % TABLE_SHARDS];
+
+    {
+        boost::mutex::scoped_lock lock(shard.mutex);
+        auto it = shard.table.find(key);
+
+        if (it != shard.table.end())
+        {
+            return it->second;
+        }
+    }
+
+    double value = 0.0;
+    std::vector<int> moves;
+
+    if (getCandidateMoves(visited, hyps, moves))
+    {
+        value = 1.0;
+    }
+    else
+    {
+        for (int room : moves)
+        {
+            value = std::max(value, evaluateMove(visited, near, hyps, room));
+
+            if (value >= 1.0)
+            {
+                break;
+            }
+        }
+    }
+
+    {
+        boost::mutex::scoped_lock lock(shard.mutex);
+
+        if (shard.table.emplace(key, value).second)
+        {
+            ++myStatesExplored;
+        }
+    }
+
+    return value;
+}
+
+double Solver::evaluateMove(const RoomSet & visited, const RoomSet & near, const hypothesis_list_t & hyps, int room)
+{
+    // Split the hypotheses surviving entry into this room by the percept seen there.
+    hypothesis_list_t nearHyps;
+    hypothesis_list_t clearHyps;
+
+    for (uint32_t hyp : hyps)
+    {
+        if (myHypotheses[hyp].wumpus.test(room))
+        {
+            continue;
+        }
+
+        if (myHypotheses[hyp].near.test(room))
+        {
+            nearHyps.push_back(hyp);
+        }
+        else
+        {
+            clearHyps.push_back(hyp);
+        }
+    }
+
+    if (room == myTreasureRoom)
+    {
+        return static_cast<double>(nearHyps.size() + clearHyps.size()) / hyps.size();
+    }
+
+    RoomSet nextVisited = visited;
+    nextVisited.set(room);
+    double winWeight = 0.0;
+
+    if (!nearHyps.empty())
+    {
+        RoomSet nextNear = near;
+        nextNear.set(room);
+        winWeight += nearHyps.size() * evaluate(nextVisited, nextNear, nearHyps);
+    }
+
+    if (!clearHyps.empty())
+    {
+        winWeight += clearHyps.size() * evaluate(nextVisited, near, clearHyps);
+    }
+
+    return winWeight / hyps.size();
+}
@@ -0,0 +1,290 @@
+﻿#include "Spectator.h"
+
+#include "OSTerminal.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <new>
+
+using namespace boost::interprocess;
+
+
+namespace
+{
+    const uint32_t RING_MAGIC = 0x43505357; // "WSPC"
+    const int SLOT_COUNT = 64;
+    const std::size_t SLOT_PAYLOAD = 16384;
+    const uint64_t NO_KEYFRAME = ~uint64_t(0);
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared-memory atomics must be lock free");
+
+    // Each slot is guarded by a sequence lock: its state is (2 * sequence + 1) while frame "sequence" is being
+    // written and (2 * sequence + 2) once complete. Readers copy the frame, then check the state is unchanged.
+    struct FrameSlot
+    {
+        std::atomic<uint64_t> state;
+        uint32_t frameType;
+        uint32_t size;
+        char payload[SLOT_PAYLOAD];
+    };
+
+    struct Ring
+    {
+        uint32_t magic;
+        std::atomic<uint64_t> writeSequence;
+        std::atomic<uint64_t> keyframeSequence;
+        FrameSlot slots[SLOT_COUNT];
+    };
+
+    // Payloads are a list of draws, each encoded as x, y, length (uint16_t) followed by the UTF-8 text.
+    const std::size_t DRAW_HEADER_SIZE = 3 * sizeof(uint16_t);
+
+    bool appendDraw(std::vector<char> & payload, int x, int y, const std::string & text)
+    {
+        if (payload.size() + DRAW_HEADER_SIZE + text.size() > SLOT_PAYLOAD)
+        {
+            return false;
+        }
+
+        uint16_t header[3] = {static_cast<uint16_t>(x), static_cast<uint16_t>(y), static_cast<uint16_t>(text.size())};
+        const char * headerBytes = reinterpret_cast<const char *>(header);
+        payload.insert(payload.end(), headerBytes, headerBytes + DRAW_HEADER_SIZE);
+        payload.insert(payload.end(), text.begin(), text.end());
+        return true;
+    }
+}
+
+
+const std::string SpectatorBroadcaster::myNamePrefix = "wumpus-spectate-";
+
+
+SpectatorBroadcaster::SpectatorBroadcaster(const std::string & name) :
+    myName(name)
+{
+    // Never take over an existing segment: it belongs to another game, and is only removed by its creator.
+    mySharedMemory = shared_memory_object(create_only, myName.c_str(), read_write);
+    mySharedMemory.truncate(sizeof(Ring));
+    myRegion = mapped_region(mySharedMemory, read_write);
+
+    Ring * ring = new (myRegion.get_address()) Ring();
+    ring->keyframeSequence.store(NO_KEYFRAME, std::memory_order_relaxed);
+    ring->magic = RING_MAGIC;
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+SpectatorBroadcaster::~SpectatorBroadcaster()
+{
+    shared_memory_object::remove(myName.c_str());
+}
+
+void SpectatorBroadcaster::draw(int x, int y, const std::string & text)
+{
+    applyToScreen(x, y, text);
+
+    // A delta too big for one slot is dropped in favor of a keyframe.
+    if (!myKeyframeNeeded && !appendDraw(myPayload, x, y, text))
+    {
+        myKeyframeNeeded = true;
+    }
+}
+
+void SpectatorBroadcaster::clear()
+{
+    myScreen.clear();
+    myKeyframeNeeded = true;
+}
+
+void SpectatorBroadcaster::flush()
+{
+    if (myKeyframeNeeded || (++myFramesSinceKeyframe >= KEYFRAME_INTERVAL))
+    {
+        encodeKeyframe();
+        publish(SpectatorFrame::KEYFRAME);
+        myKeyframeNeeded = false;
+        myFramesSinceKeyframe = 0;
+    }
+    else if (!myPayload.empty())
+    {
+        publish(SpectatorFrame::DELTA);
+    }
+
+    myPayload.clear();
+}
+
+void SpectatorBroadcaster::applyToScreen(int x, int y, const std::string & text)
+{
+    // Keep a shadow of the screen, one UTF-8 character per cell, for building keyframes.
+    if (y >= static_cast<int>(myScreen.size()))
+    {
+        myScreen.resize(y + 1);
+    }
+
+    std::vector<std::string> & row = myScreen[y];
+
+    for (std::size_t i = 0; i < text.size(); ++x)
+    {
+        std::size_t length = 1;
+
+        while ((i + length < text.size()) && ((text[i + length] & 0xC0) == 0x80))
+        {
+            ++length;
+        }
+
+        if (x >= static_cast<int>(row.size()))
+        {
+            row.resize(x + 1, " ");
+        }
+
+        row[x].assign(text, i, length);
+        i += length;
+    }
+}
+
+void SpectatorBroadcaster::encodeKeyframe()
+{
+    // A screen too big for one slot is truncated to the rows that fit.
+    myPayload.clear();
+
+    for (std::size_t y = 0; y < myScreen.size(); ++y)
+    {
+        std::string line;
+
+        for (const std::string & cell : myScreen[y])
+        {
+            line += cell;
+        }
+
+        if (!line.empty() && !appendDraw(myPayload, 0, y, line))
+        {
+            break;
+        }
+    }
+}
+
+void SpectatorBroadcaster::publish(int frameType)
+{
+    Ring & ring = *static_cast<Ring *>(myRegion.get_address());
+    uint64_t sequence = ring.writeSequence.load(std::memory_order_relaxed);
+    FrameSlot & slot = ring.slots[sequence % SLOT_COUNT];
+
+    slot.state.store(sequence * 2 + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.frameType = frameType;
+    slot.size = static_cast<uint32_t>(myPayload.size());
+    std::memcpy(slot.payload, myPayload.data(), myPayload.size());
+
+    slot.state.store(sequence * 2 + 2, std::memory_order_release);
+
+    if (frameType == SpectatorFrame::KEYFRAME)
+    {
+        ring.keyframeSequence.store(sequence, std::memory_order_release);
+    }
+
+    ring.writeSequence.store(sequence + 1, std::memory_order_release);
+}
+
+
+SpectatorViewer::SpectatorViewer(const std::string & name, ITerminal * terminal) :
+    myName(name),
+    myTerminal(terminal)
+{
+}
+
+bool SpectatorViewer::attach()
+{
+    try
+    {
+        mySharedMemory = shared_memory_object(open_only, myName.c_str(), read_only);
+        myRegion = mapped_region(mySharedMemory, read_only);
+    }
+    catch (interprocess_exception &)
+    {
+        return false;
+    }
+
+    const Ring & ring = *static_cast<const Ring *>(myRegion.get_address());
+
+    if ((myRegion.get_size() < sizeof(Ring)) || (ring.magic != RING_MAGIC))
+    {
+        return false;
+    }
+
+    uint64_t keyframe = ring.keyframeSequence.load(std::memory_order_acquire);
+    myNextSequence = (keyframe == NO_KEYFRAME) ? ring.writeSequence.load(std::memory_order_acquire) : keyframe;
+    myKeyframeNeeded = true;
+    return true;
+}
+
+void SpectatorViewer::update()
+{
+    const Ring & ring = *static_cast<const Ring *>(myRegion.get_address());
+    std::vector<char> payload;
+    bool applied = false;
+
+    while (myNextSequence < ring.writeSequence.load(std::memory_order_acquire))
+    {
+        const FrameSlot & slot = ring.slots[myNextSequence % SLOT_COUNT];
+        uint64_t expected = myNextSequence * 2 + 2;
+        uint64_t state = slot.state.load(std::memory_order_acquire);
+        int frameType = 0;
+
+        if (state == expected)
+        {
+            frameType = slot.frameType;
+            payload.assign(slot.payload, slot.payload + std::min<std::size_t>(slot.size, SLOT_PAYLOAD));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            state = slot.state.load(std::memory_order_relaxed);
+        }
+
+        if (state < expected)
+        {
+            // Not finished writing yet.
+            break;
+        }
+
+        if (state > expected)
+        {
+            // Overwritten before we read it: resume from the latest keyframe, or wait for the next one.
+            uint64_t keyframe = ring.keyframeSequence.load(std::memory_order_acquire);
+            myNextSequence = ((keyframe != NO_KEYFRAME) && (keyframe > myNextSequence)) ? keyframe :
+                ring.writeSequence.load(std::memory_order_acquire);
+            myKeyframeNeeded = true;
+            continue;
+        }
+
+        if (!myKeyframeNeeded || (frameType == SpectatorFrame::KEYFRAME))
+        {
+            applyFrame(frameType, payload);
+            myKeyframeNeeded = false;
+            applied = true;
+        }
+
+        ++myNextSequence;
+    }
+
+    if (applied)
+    {
+        myTerminal->doRefresh();
+    }
+}
+
+void SpectatorViewer::applyFrame(int frameType, const std::vector<char> & payload)
+{
+    if (frameType == SpectatorFrame::KEYFRAME)
+    {
+        myTerminal->clearScreen();
+    }
+
+    for (std::size_t offset = 0; offset + DRAW_HEADER_SIZE <= payload.size(); )
+    {
+        uint16_t header[3];
+        std::memcpy(header, &payload[offset], DRAW_HEADER_SIZE);
+        offset += DRAW_HEADER_SIZE;
+
+        std::size_t length = std::min<std::size_t>(header[2], payload.size() - offset);
+        myTerminal->setCursorPos(header[0], header[1]);
+        myTerminal->output(std::string(&payload[offset], length), false);
+        offset += length;
+    }
+}
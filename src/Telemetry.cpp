@@ -0,0 +1,107 @@
+﻿#include "Telemetry.h"
+
+#include <cstdio>
+#include <fstream>
+
+
+const Telemetry::MetricInfo Telemetry::myMetricInfo[Metric::MAX] = {
+    {"wumpus_games_started_total", "Games started."},
+    {"wumpus_games_won_total", "Games won by finding the treasure."},
+    {"wumpus_games_lost_total", "Games lost to a wumpus."},
+    {"wumpus_moves_total", "Moves made between rooms."},
+    {"wumpus_bad_moves_total", "Moves rejected for not being to an adjacent room."},
+    {"wumpus_marks_placed_total", "Wumpus or unknown marks placed on rooms."},
+    {"wumpus_frames_rendered_total", "Full world frames rendered."},
+    {"wumpus_terminal_bytes_total", "Bytes written to the terminal by the world."}
+};
+
+boost::mutex Telemetry::myRegistryMutex;
+std::vector<std::unique_ptr<Telemetry::CounterBlock>> Telemetry::myRegistry;
+
+
+Telemetry::Telemetry(const std::string & path, const std::string & instance,
+    boost::posix_time::time_duration interval) :
+    myPath(path),
+    myInstance(instance),
+    myInterval(interval)
+{
+    // Counting goes on regardless, but nothing is exported without a path.
+    if (!myPath.empty())
+    {
+        myExportThread = boost::thread(&Telemetry::exportLoop, this);
+    }
+}
+
+Telemetry::~Telemetry()
+{
+    if (myPath.empty())
+    {
+        return;
+    }
+
+    myExportThread.interrupt();
+    myExportThread.join();
+
+    // The file only describes a live process; leaving it behind would have collectors export a dead instance.
+    std::remove(myPath.c_str());
+}
+
+uint64_t Telemetry::getTotal(int metric)
+{
+    boost::mutex::scoped_lock lock(myRegistryMutex);
+    uint64_t total = 0;
+
+    for (const auto & block : myRegistry)
+    {
+        total += block->counters[metric].load(std::memory_order_relaxed);
+    }
+
+    return total;
+}
+
+Telemetry::CounterBlock * Telemetry::registerThread()
+{
+    // Blocks outlive their threads so counts from finished threads are still exported.
+    boost::mutex::scoped_lock lock(myRegistryMutex);
+    myRegistry.push_back(std::make_unique<CounterBlock>());
+    return myRegistry.back().get();
+}
+
+void Telemetry::exportLoop()
+{
+    try
+    {
+        while (true)
+        {
+            boost::this_thread::sleep(myInterval);
+            exportMetrics();
+        }
+    }
+    catch (boost::thread_interrupted &)
+    {
+    }
+}
+
+void Telemetry::exportMetrics() const
+{
+    // Write to a temporary file and rename it into place, so scrapers never see a partial file.
+    std::string tempPath = myPath + ".tmp";
+
+    {
+        std::ofstream ofs(tempPath, std::ios::trunc);
+
+        for (int metric = 0; metric < Metric::MAX; ++metric)
+        {
+            ofs << "# HELP " << myMetricInfo[metric].name << ' ' << myMetricInfo[metric].help << '\n' <<
+                "# TYPE " << myMetricInfo[metric].name << " counter\n" <<
+                myMetricInfo[metric].name << "{instance=\"" << myInstance << "\"} " << getTotal(metric) << '\n';
+        }
+
+        if (!ofs.flush())
+        {
+            return;
+        }
+    }
+
+    std::rename(tempPath.c_str(), myPath.c_str());
+}
@@ -0,0 +1,272 @@
+﻿#include "Tournament.h"
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <chrono>
+#include <deque>
+#include <ostream>
+#include <random>
+
+using namespace RoomProp;
+
+
+// Task deque owned by one worker: the owner pops from the back, idle workers steal from the front.
+class Tournament::WorkStealingQueue
+{
+public:
+    void push(const Task & task)
+    {
+        boost::mutex::scoped_lock lock(myMutex);
+        myTasks.push_back(task);
+    }
+
+    bool pop(Task & task)
+    {
+        boost::mutex::scoped_lock lock(myMutex);
+
+        if (myTasks.empty())
+        {
+            return false;
+        }
+
+        task = myTasks.back();
+        myTasks.pop_back();
+        return true;
+    }
+
+    bool steal(Task & task)
+    {
+        boost::mutex::scoped_lock lock(myMutex);
+
+        if (myTasks.empty())
+        {
+            return false;
+        }
+
+        task = myTasks.front();
+        myTasks.pop_front();
+        return true;
+    }
+
+private:
+    boost::mutex myMutex;
+    std::deque<Task> myTasks;
+};
+
+
+void Tournament::addWorld(const World::RawData & rawData, bool randomWumpuses)
+{
+    // Load the world once here, so a world that World rejects (e.g. too many keys) throws to the caller rather than
+    // terminating a worker thread. Random placements only move wumpuses, which World doesn't limit.
+    World(nullptr, rawData);
+
+    TournamentWorld world;
+    world.rawData = rawData;
+    world.baseData.assign(rawData.data, rawData.data + rawData.width * rawData.height);
+    world.wumpusCount = 0;
+    world.randomWumpuses = randomWumpuses;
+
+    if (!randomWumpuses)
+    {
+        myWorlds.push_back(std::move(world));
+        return;
+    }
+
+    int startRoom = rawData.startY * rawData.width + rawData.startX;
+
+    for (int room = 0; room < rawData.width * rawData.height; ++room)
+    {
+        if (world.baseData[room] & WUMPUS)
+        {
+            ++world.wumpusCount;
+            world.baseData[room] &= ~WUMPUS;
+        }
+
+        if ((world.baseData[room] & VALID) && !(world.baseData[room] & TREASURE) && (room != startRoom))
+        {
+            world.candidates.push_back(room);
+        }
+    }
+
+    myWorlds.push_back(std::move(world));
+}
+
+void Tournament::addAgent(agent_factory_t factory)
+{
+    myAgentFactories.push_back(std::move(factory));
+}
+
+void Tournament::run(int gamesPerPair, int threadCount, uint32_t seed)
+{
+    if (threadCount <= 0)
+    {
+        threadCount = std::max(1u, boost::thread::hardware_concurrency());
+    }
+
+    // Deal tasks round-robin; workers that run dry steal from the others.
+    std::vector<std::unique_ptr<WorkStealingQueue>> queues;
+
+    for (int i = 0; i < threadCount; ++i)
+    {
+        queues.push_back(std::make_unique<WorkStealingQueue>());
+    }
+
+    int taskCount = 0;
+
+    for (int agent = 0; agent < static_cast<int>(myAgentFactories.size()); ++agent)
+    {
+        for (int world = 0; world < static_cast<int>(myWorlds.size()); ++world)
+        {
+            for (int game = 0; game < gamesPerPair; game += GAMES_PER_TASK)
+            {
+                queues[taskCount++ % threadCount]->push(
+                    {agent, world, game, std::min(GAMES_PER_TASK, gamesPerPair - game)});
+            }
+        }
+    }
+
+    // Workers accumulate into their own results, merged once all are done.
+    std::vector<std::vector<AgentResult>> workerResults(threadCount,
+        std::vector<AgentResult>(myAgentFactories.size()));
+    boost::thread_group workers;
+
+    for (int worker = 0; worker < threadCount; ++worker)
+    {
+        workers.create_thread([this, worker, threadCount, seed, &queues, &workerResults]() {
+            std::vector<std::unique_ptr<IAgent>> agents;
+            std::vector<room_data_t> data;
+
+            for (const auto & factory : myAgentFactories)
+            {
+                agents.push_back(factory());
+            }
+
+            Task task;
+
+            while (true)
+            {
+                bool found = queues[worker]->pop(task);
+
+                for (int i = 1; !found && (i < threadCount); ++i)
+                {
+                    found = queues[(worker + i) % threadCount]->steal(task);
+                }
+
+                if (!found)
+                {
+                    break;
+                }
+
+                runTask(task, *agents[task.agent], data, seed, workerResults[worker][task.agent]);
+            }
+        });
+    }
+
+    workers.join_all();
+
+    myResults.assign(myAgentFactories.size(), AgentResult());
+
+    for (std::size_t agent = 0; agent < myAgentFactories.size(); ++agent)
+    {
+        myResults[agent].name = myAgentFactories[agent]()->getName();
+
+        for (const auto & results : workerResults)
+        {
+            myResults[agent].games += results[agent].games;
+            myResults[agent].wins += results[agent].wins;
+            myResults[agent].moves += results[agent].moves;
+            myResults[agent].seconds += results[agent].seconds;
+        }
+    }
+}
+
+void Tournament::writeCsv(std::ostream & os) const
+{
+    // Games per second is per thread, i.e. games divided by the thread time spent on that agent.
+    os << "agent,games,win_rate,mean_moves,games_per_sec\n";
+
+    for (const AgentResult & result : myResults)
+    {
+        double games = static_cast<double>(result.games);
+        os << result.name << ',' << result.games << ',' <<
+            (result.games ? result.wins / games : 0.0) << ',' <<
+            (result.games ? result.moves / games : 0.0) << ',' <<
+            (result.seconds > 0.0 ? games / result.seconds : 0.0) << '\n';
+    }
+}
+
+void Tournament::runTask(const Task & task, IAgent & agent, std::vector<room_data_t> & data, uint32_t seed,
+    AgentResult & result) const
+{
+    const TournamentWorld & world = myWorlds[task.world];
+    World::RawData rawData = world.rawData;
+    int maxMoves = 4 * rawData.width * rawData.height;
+    auto startTime = std::chrono::steady_clock::now();
+
+    for (int game = task.firstGame; game < task.firstGame + task.gameCount; ++game)
+    {
+        // Seed from the game's coordinates so results don't depend on scheduling.
+        std::seed_seq seedSeq{seed, static_cast<uint32_t>(task.agent), static_cast<uint32_t>(task.world),
+            static_cast<uint32_t>(game)};
+        std::mt19937 rng(seedSeq);
+
+        data = world.baseData;
+
+        if (world.randomWumpuses)
+        {
+            std::vector<int> candidates = world.candidates;
+
+            for (int i = 0; (i < world.wumpusCount) && (i < static_cast<int>(candidates.size())); ++i)
+            {
+                std::swap(candidates[i],
+                    candidates[std::uniform_int_distribution<int>(i, candidates.size() - 1)(rng)]);
+                data[candidates[i]] |= WUMPUS;
+            }
+        }
+
+        rawData.data = data.data();
+        World gameWorld(nullptr, rawData);
+        agent.reset(gameWorld, rng());
+
+        int moves = 0;
+
+        while (!gameWorld.isGameOver() && (moves < maxMoves))
+        {
+            int x = gameWorld.getCurrX();
+            int y = gameWorld.getCurrY();
+
+            switch (agent.chooseMove(gameWorld, World::LOCAL_PLAYER))
+            {
+            case World::MoveDirection::up:
+                --y;
+                break;
+
+            case World::MoveDirection::down:
+                ++y;
+                break;
+
+            case World::MoveDirection::left:
+                --x;
+                break;
+
+            case World::MoveDirection::right:
+                ++x;
+                break;
+            }
+
+            gameWorld.setSelection(x, y);
+            gameWorld.move();
+            ++moves;
+        }
+
+        ++result.games;
+        result.moves += moves;
+
+        if (gameWorld.isWon())
+        {
+            ++result.wins;
+        }
+    }
+
+    result.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+}
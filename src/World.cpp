@@ -1,13 +1,19 @@
 ﻿#include "World.h"
 
 #include "OSTerminal.h"
+#include "Snapshot.h"
+#include "Spectator.h"
+#include "Telemetry.h"
+#include <algorithm>
 #include <cmath>
 #include <iostream>
+#include <limits>
+#include <stdexcept>
 
 using namespace RoomProp;
 
 
-const room_data_t World::myDefaultRoomData[] = {
+const room_data_t WorldBase::myDefaultRoomData[] = {
     0,      0,      VALID,          VALID|TREASURE, VALID,  0,              0,
     0,      VALID,  VALID|WUMPUS,   VALID,          VALID,  VALID,          0,
     VALID,  VALID,  VALID,          VALID,          VALID,  VALID|WUMPUS,   VALID,
@@ -16,16 +22,45 @@ const room_data_t World::myDefaultRoomData[] = {
     0,      0,      VALID,          VALID,          VALID,  0,              0
 };
 
-const World::RawData World::myDefaultRawData = {
+const WorldBase::RawData WorldBase::myDefaultRawData = {
     7, 6, 3, 5, myDefaultRoomData
 };
 
+const room_data_t WorldBase::myCavernRoomData[] = {
+    0,      VALID,  VALID,          VALID,  0,              VALID,  VALID,          VALID|TREASURE, 0,
+    VALID,  VALID,  VALID|WUMPUS,   VALID,  VALID,          VALID,  VALID,          VALID,          0,
+    VALID,  VALID,  VALID,          0,      VALID,          VALID,  VALID|WUMPUS,   VALID,          VALID,
+    VALID,  VALID,  VALID,          VALID,  VALID,          0,      VALID,          VALID,          VALID,
+    0,      VALID,  VALID,          VALID,  VALID|WUMPUS,   VALID,  VALID,          VALID,          0,
+    0,      0,      VALID,          VALID,  VALID,          VALID,  VALID,          0,              0
+};
+
+const room_data_t WorldBase::myLabyrinthRoomData[] = {
+    VALID|TREASURE|LOCKED,  VALID,  VALID,          0,      VALID,  VALID,          VALID,          VALID,  VALID,          0,
+    VALID,                  0,      VALID|WUMPUS,   VALID,  VALID,  0,              VALID,          0,      VALID,          VALID,
+    VALID,                  VALID,  VALID,          0,      VALID,  VALID,          VALID|WUMPUS,   VALID,  VALID,          VALID,
+    0,                      VALID,  0,              VALID,  VALID,  VALID,          0,              VALID,  0,              VALID|KEY,
+    VALID,                  VALID,  VALID,          VALID,  0,      VALID|WUMPUS,   VALID,          VALID,  VALID,          VALID,
+    VALID,                  0,      VALID,          VALID,  VALID,  VALID,          VALID,          0,      VALID|WUMPUS,   VALID,
+    VALID,                  VALID,  VALID,          0,      VALID,  VALID,          VALID,          VALID,  VALID,          0
+};
+
+// Levels played in order, the first being the default world.
+const WorldBase::RawData WorldBase::myLevelRawData[] = {
+    myDefaultRawData,
+    {9, 6, 4, 5, myCavernRoomData},
+    {10, 7, 6, 6, myLabyrinthRoomData}
+};
+
+// Room properties making up the player overlay saved in snapshots.
+const room_data_t WorldBase::mySnapshotProps = MARK_WUMPUS | MARK_UNKNOWN | VISITED;
+
 // Indexed as bDCBA, where:
 //  A = RoomAdjacency::TOPLEFT
 //  B = RoomAdjacency::TOPRIGHT
 //  C = RoomAdjacency::BOTTOMLEFT
 //  D = RoomAdjacency::BOTTOMRIGHT
-const std::string World::myCornerStyles[][2] = {
+const std::string WorldBase::myCornerStyles[][2] = {
     {" ", " "},
     {"┘", "╝"},
     {"└", "╚"},
@@ -44,159 +79,370 @@ const std::string World::myCornerStyles[][2] = {
     {"┼", "╬"}
 };
 
-const std::string World::myLineStyles[][2] = {
+const std::string WorldBase::myLineStyles[][2] = {
     {"───", "═══"},
     {"│ ", "║ "},
     {" │", " ║"}
 };
 
-const std::string World::mySpecialSymbols[] = {
+const std::string WorldBase::mySpecialSymbols[] = {
     "ʘ", // "😎",
     "ω", // "👹",
-    "🔑",
+    "⚷", // "🔑",
     "▣", // "🔒",
-    "?" // "❓️"
+    "?", // "❓️"
+    "☻" // "🙂", other players
+};
+
+// Minimap cells without the player or a wumpus mark: no valid room, valid rooms only, visited rooms.
+const std::string WorldBase::myMinimapSymbols[] = {
+    " ",
+    "░",
+    "▒"
 };
 
-const std::string World::myMessages[WorldMessage::MAX] = {
+const std::string WorldBase::myMessages[WorldMessage::MAX] = {
     "                                                                                ",
     "Sorry, you can only move 1 space at a time.                                     ",
+    "This room is locked - you need its key.                                         ",
+    "You've found a key!                                                             ",
     "You hear a wumpus lurking nearby...                                             ",
     "AAAACK! You've been eaten by a wumpus!                                          ",
     "You've found the treasure - you win!                                            ",
-    "--- Press a key to exit ---                                                     "
+    "--- Press a key to exit ---                                                     ",
+    "--- Press a key to continue to the next level ---                               "
 };
 
 
-World::World(ITerminal * terminal) :
-    myTerminal(terminal)
+int WorldBase::getLevelCount()
+{
+    return sizeof(myLevelRawData) / sizeof(myLevelRawData[0]);
+}
+
+const WorldBase::RawData & WorldBase::getLevelRawData(int level)
+{
+    return myLevelRawData[level];
+}
+
+bool WorldBase::readRawData(std::istream & is, std::vector<room_data_t> & data, RawData & rawData)
+{
+    int width;
+    int height;
+    int startX;
+    int startY;
+
+    if (!(is >> width >> height >> startX >> startY) || (width <= 0) || (height <= 0) ||
+        (startX < 0) || (startX >= width) || (startY < 0) || (startY >= height))
+    {
+        return false;
+    }
+
+    data.assign(static_cast<std::size_t>(width) * height, 0);
+
+    for (std::size_t room = 0; room < data.size(); ++room)
+    {
+        unsigned int props;
+        char separator;
+
+        if (!(is >> props) || (props > std::numeric_limits<room_data_t>::max()) ||
+            ((static_cast<int>(room % width) != width - 1) && !((is >> separator) && (separator == ','))))
+        {
+            return false;
+        }
+
+        data[room] = static_cast<room_data_t>(props);
+    }
+
+    if (!(data[startY * width + startX] & VALID))
+    {
+        return false;
+    }
+
+    rawData = {width, height, startX, startY, data.data()};
+    return true;
+}
+
+
+template<typename Storage>
+BasicWorld<Storage>::BasicWorld(ITerminal * terminal)
 {
+    myPlayers[LOCAL_PLAYER] = std::make_unique<PlayerState>();
+    myPlayers[LOCAL_PLAYER]->terminal = terminal;
+    myPlayerCount = 1;
     load(myDefaultRawData);
 }
 
-void World::load(const RawData & rawData)
+template<typename Storage>
+BasicWorld<Storage>::BasicWorld(ITerminal * terminal, const RawData & rawData)
+{
+    myPlayers[LOCAL_PLAYER] = std::make_unique<PlayerState>();
+    myPlayers[LOCAL_PLAYER]->terminal = terminal;
+    myPlayerCount = 1;
+    load(rawData);
+}
+
+template<typename Storage>
+void BasicWorld<Storage>::load(const RawData & rawData)
 {
     myWidth = rawData.width;
     myHeight = rawData.height;
-    mySelectX = myCurrX = rawData.startX;
-    mySelectY = myCurrY = rawData.startY;
+    myStartX = rawData.startX;
+    myStartY = rawData.startY;
 
-    // Allocate contiguous block that can be accessed via 2D array.
-    myRoomData = std::make_unique<room_data_t[]>(myWidth * myHeight);
-    myRoomGrid = std::make_unique<room_data_t*[]>(myWidth);
+    // Copy the raw data into the room storage, which may use a narrower cell type and a different layout.
+    // The rooms are not modified during play, so players can read them without synchronization; what players
+    // change is kept in their own overlay or in the shared key and lock masks.
+    myRooms.resize(myWidth, myHeight);
 
     for (int y = 0; y < myHeight; ++y)
     {
-        myRoomGrid[y] = &myRoomData[y * myWidth];
+        for (int x = 0; x < myWidth; ++x)
+        {
+            myRooms.at(x, y) = static_cast<cell_t>(rawData.data[y * myWidth + x] & ~mySnapshotProps);
+        }
+    }
+
+    for (int player = 0; player < getPlayerCount(); ++player)
+    {
+        resetPlayer(*myPlayers[player]);
+    }
+
+    buildMinimap();
+    myKeys = 0;
+    myUnlocked = 0;
+
+    // FNV-1a hash of the base world, so snapshots can refer to it rather than storing it.
+    myBaseHash = 0xcbf29ce484222325ull;
+
+    auto hashBytes = [this](const void * data, std::size_t size) {
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            myBaseHash = (myBaseHash ^ static_cast<const uint8_t *>(data)[i]) * 0x100000001b3ull;
+        }
+    };
+
+    hashBytes(&rawData.width, sizeof(rawData.width));
+    hashBytes(&rawData.height, sizeof(rawData.height));
+    hashBytes(&rawData.startX, sizeof(rawData.startX));
+    hashBytes(&rawData.startY, sizeof(rawData.startY));
+    hashBytes(rawData.data, myWidth * myHeight * sizeof(room_data_t));
+
+    buildReachIndex();
+
+    // Players enter the start room as the level begins, so a key there is picked up straight away, as the solver
+    // and the reachability index assume.
+    int startKeyId = getKeyId(myStartY * myWidth + myStartX);
+
+    if (startKeyId >= 0)
+    {
+        myKeys = key_mask_t(1) << startKeyId;
     }
+}
+
+template<typename Storage>
+int BasicWorld<Storage>::addPlayer(ITerminal * terminal)
+{
+    // Joins are serialized, and the new slot is filled before the count publishes it to the playing threads.
+    boost::mutex::scoped_lock lock(myJoinMutex);
+    int player = getPlayerCount();
+
+    if (player == MAX_PLAYERS)
+        throw std::runtime_error("Too many players in world");
 
-    // Now copy the raw data in.
-    std::memcpy(myRoomData.get(), rawData.data, myWidth * myHeight * sizeof(room_data_t));
+    myPlayers[player] = std::make_unique<PlayerState>();
+    myPlayers[player]->terminal = terminal;
+    resetPlayer(*myPlayers[player]);
+    myPlayerCount.store(player + 1, std::memory_order_release);
+
+    for (int other = 0; other < player; ++other)
+    {
+        addDamage(myStartX, myStartY, other);
+    }
+
+    return player;
 }
 
-void World::render() const
+template<typename Storage>
+void BasicWorld<Storage>::render(int player) const
 {
-    for (int y = 0; y < myHeight; ++y)
+    const PlayerState & state = *myPlayers[player];
+
+    // Worlds without a terminal run headless, e.g. in tournaments.
+    if (!state.terminal)
     {
-        for (int x = 0; x < myWidth; ++x)
+        return;
+    }
+
+    for (int y = state.viewY; y < state.viewY + getViewHeight(); ++y)
+    {
+        for (int x = state.viewX; x < state.viewX + getViewWidth(); ++x)
         {
-            if (myRoomGrid[y][x] & VALID)
+            if (myRooms.at(x, y) & VALID)
             {
-                renderRoom(x, y);
+                renderRoom(x, y, player);
             }
         }
     }
 
     // Render selected room again to ensure double lines are "on top".
-    renderSelectedRoom();
+    renderSelectedRoom(player);
 
-    myTerminal->doRefresh();
+    if (player == LOCAL_PLAYER)
+    {
+        renderMinimap();
+    }
+
+    state.terminal->doRefresh();
+    Telemetry::increment(Metric::FRAMES_RENDERED);
 }
 
-void World::renderRoom(int x, int y) const
+template<typename Storage>
+void BasicWorld<Storage>::renderRoom(int x, int y, int player) const
 {
-    updateKernel(x, y);
+    const PlayerState & state = *myPlayers[player];
+
+    if (!state.terminal)
+    {
+        return;
+    }
+
+    if (!isInView(state, x, y))
+    {
+        return;
+    }
 
-    int xOffset = x * 4;
-    int yOffset = y * 2;
+    int xOffset = (x - state.viewX) * 4;
+    int yOffset = (y - state.viewY) * 2;
     int drawStyle = DrawStyle::SINGLE;
 
-    if ((x == mySelectX) && (y == mySelectY))
+    if ((x == state.selectX) && (y == state.selectY))
     {
         drawStyle = DrawStyle::DOUBLE;
     }
 
+    // Spectators follow the local player's view.
+    bool broadcasting = (player == LOCAL_PLAYER);
+    Kernel kernel;
+    updateKernel(x, y, kernel);
+
     std::ostringstream ossTop;
-    ossTop << getCornerStyle(0, 0, drawStyle) << myLineStyles[LineStyle::HORIZONTAL][drawStyle] <<
-        getCornerStyle(1, 0, drawStyle);
-    myTerminal->setCursorPos(xOffset, yOffset);
-    myTerminal->output(ossTop, false);
+    ossTop << getCornerStyle(kernel, 0, 0, drawStyle) << myLineStyles[LineStyle::HORIZONTAL][drawStyle] <<
+        getCornerStyle(kernel, 1, 0, drawStyle);
+    state.terminal->setCursorPos(xOffset, yOffset);
+    state.terminal->output(ossTop, false);
 
     std::ostringstream ossMiddle;
-    ossMiddle << myLineStyles[LineStyle::LEFT_VERT][drawStyle] << getRoomContent(x, y) <<
+    ossMiddle << myLineStyles[LineStyle::LEFT_VERT][drawStyle] << getRoomContent(x, y, player) <<
         myLineStyles[LineStyle::RIGHT_VERT][drawStyle];
-    myTerminal->setCursorPos(xOffset, yOffset + 1);
-    myTerminal->output(ossMiddle, false);
+    state.terminal->setCursorPos(xOffset, yOffset + 1);
+    state.terminal->output(ossMiddle, false);
 
     std::ostringstream ossBottom;
-    ossBottom << getCornerStyle(0, 1, drawStyle) << myLineStyles[LineStyle::HORIZONTAL][drawStyle] <<
-        getCornerStyle(1, 1, drawStyle);
-    myTerminal->setCursorPos(xOffset, yOffset + 2);
-    myTerminal->output(ossBottom, false);
+    ossBottom << getCornerStyle(kernel, 0, 1, drawStyle) << myLineStyles[LineStyle::HORIZONTAL][drawStyle] <<
+        getCornerStyle(kernel, 1, 1, drawStyle);
+    state.terminal->setCursorPos(xOffset, yOffset + 2);
+    state.terminal->output(ossBottom, false);
+
+    if (broadcasting)
+    {
+        broadcast(xOffset, yOffset, ossTop.str());
+        broadcast(xOffset, yOffset + 1, ossMiddle.str());
+        broadcast(xOffset, yOffset + 2, ossBottom.str());
+    }
+
+    Telemetry::increment(Metric::BYTES_WRITTEN, ossTop.tellp() + ossMiddle.tellp() + ossBottom.tellp());
 }
 
-void World::renderSelectedRoom() const
+template<typename Storage>
+void BasicWorld<Storage>::renderSelectedRoom(int player) const
 {
-    renderRoom(mySelectX, mySelectY);
+    renderRoom(myPlayers[player]->selectX, myPlayers[player]->selectY, player);
 }
 
-void World::moveSelection(MoveDirection direction)
+template<typename Storage>
+void BasicWorld<Storage>::renderDamage(int player)
 {
+    PlayerState & state = *myPlayers[player];
+    std::vector<int> damage;
+
+    {
+        boost::mutex::scoped_lock lock(state.damageMutex);
+        damage.swap(state.damage);
+    }
+
+    if (damage.empty() || !state.terminal)
+    {
+        return;
+    }
+
+    // Only the rooms other players entered or left are redrawn, each once.
+    std::sort(damage.begin(), damage.end());
+    damage.erase(std::unique(damage.begin(), damage.end()), damage.end());
+
+    for (int room : damage)
+    {
+        renderRoom(room % myWidth, room / myWidth, player);
+    }
+
+    renderSelectedRoom(player);
+    state.terminal->doRefresh();
+}
+
+template<typename Storage>
+void BasicWorld<Storage>::displayPercept(int player) const
+{
+    displayMessage(myMessages[isNearWumpus(player) ? WorldMessage::NEARWUMPUS : WorldMessage::CLEAR], 0, player);
+}
+
+template<typename Storage>
+void BasicWorld<Storage>::moveSelection(MoveDirection direction, int player)
+{
+    PlayerState & state = *myPlayers[player];
     bool dirty = false;
-    int oldX = mySelectX;
-    int oldY = mySelectY;
+    int oldX = state.selectX;
+    int oldY = state.selectY;
 
     switch (direction)
     {
     case MoveDirection::up:
-        if (mySelectY > 0)
+        if (state.selectY > 0)
         {
-            if (myRoomGrid[mySelectY - 1][mySelectX] & VALID)
+            if (myRooms.at(state.selectX, state.selectY - 1) & VALID)
             {
-                --mySelectY;
+                --state.selectY;
                 dirty = true;
             }
         }
         break;
 
     case MoveDirection::down:
-        if (mySelectY < myHeight - 1)
+        if (state.selectY < myHeight - 1)
         {
-            if (myRoomGrid[mySelectY + 1][mySelectX] & VALID)
+            if (myRooms.at(state.selectX, state.selectY + 1) & VALID)
             {
-                ++mySelectY;
+                ++state.selectY;
                 dirty = true;
             }
         }
         break;
 
     case MoveDirection::left:
-        if (mySelectX > 0)
+        if (state.selectX > 0)
         {
-            if (myRoomGrid[mySelectY][mySelectX - 1] & VALID)
+            if (myRooms.at(state.selectX - 1, state.selectY) & VALID)
             {
-                --mySelectX;
+                --state.selectX;
                 dirty = true;
             }
         }
         break;
 
     case MoveDirection::right:
-        if (mySelectX < myWidth - 1)
+        if (state.selectX < myWidth - 1)
         {
-            if (myRoomGrid[mySelectY][mySelectX + 1] & VALID)
+            if (myRooms.at(state.selectX + 1, state.selectY) & VALID)
             {
-                ++mySelectX;
+                ++state.selectX;
                 dirty = true;
             }
         }
@@ -205,85 +451,191 @@ void World::moveSelection(MoveDirection direction)
 
     if (dirty)
     {
-        renderRoom(oldX, oldY);
-        renderSelectedRoom();
+        updateSelection(oldX, oldY, player);
     }
 }
 
-void World::move()
+template<typename Storage>
+void BasicWorld<Storage>::setSelection(int x, int y, int player)
 {
-    int distance = std::abs(myCurrX - mySelectX) + std::abs(myCurrY - mySelectY);
+    PlayerState & state = *myPlayers[player];
+
+    if (!isRoomValid(x, y) || ((x == state.selectX) && (y == state.selectY)))
+    {
+        return;
+    }
+
+    int oldX = state.selectX;
+    int oldY = state.selectY;
+
+    state.selectX = x;
+    state.selectY = y;
+
+    updateSelection(oldX, oldY, player);
+}
+
+template<typename Storage>
+void BasicWorld<Storage>::move(int player)
+{
+    PlayerState & state = *myPlayers[player];
+    int distance = std::abs(state.currX - state.selectX) + std::abs(state.currY - state.selectY);
 
     if (distance != 1)
     {
-        displayMessage(myMessages[WorldMessage::BADMOVE], 0);
+        displayMessage(myMessages[WorldMessage::BADMOVE], 0, player);
+        Telemetry::increment(Metric::BAD_MOVES);
+        return;
+    }
+
+    int room = state.selectY * myWidth + state.selectX;
+    int lockId = getLockId(room);
+
+    if (isRoomLocked(state.selectX, state.selectY) && !(getKeys() & (key_mask_t(1) << lockId)))
+    {
+        displayMessage(myMessages[WorldMessage::LOCKED], 0, player);
         return;
     }
 
-    int oldX = myCurrX;
-    int oldY = myCurrY;
+    // Rooms stay unlocked once opened, and keys are kept for the rest of the level. Both are shared by all
+    // players, so they are claimed atomically and only the first player into a key room finds the key.
+    if (lockId >= 0)
+    {
+        myUnlocked.fetch_or(key_mask_t(1) << lockId, std::memory_order_acq_rel);
+    }
+
+    bool keyFound = false;
+    int keyId = getKeyId(room);
 
-    myCurrX = mySelectX;
-    myCurrY = mySelectY;
+    if (keyId >= 0)
+    {
+        key_mask_t keyBit = key_mask_t(1) << keyId;
+        keyFound = !(myKeys.fetch_or(keyBit, std::memory_order_acq_rel) & keyBit);
+    }
+
+    int oldX = state.currX;
+    int oldY = state.currY;
 
-    renderRoom(oldX, oldY);
-    renderRoom(myCurrX, myCurrY);
+    state.currX = state.selectX;
+    state.currY = state.selectY;
+    state.room.store(room, std::memory_order_release);
 
-    if (myRoomGrid[myCurrY][myCurrX] & WUMPUS)
+    state.overlay[room] |= VISITED;
+    Telemetry::increment(Metric::MOVES);
+
+    renderRoom(oldX, oldY, player);
+    renderRoom(state.currX, state.currY, player);
+
+    for (int other = 0; other < getPlayerCount(); ++other)
     {
-        displayMessage(myMessages[WorldMessage::LOSE], 0);
-        displayMessage(myMessages[WorldMessage::EXIT], 1);
-        myGameOver = true;
+        if (other != player)
+        {
+            addDamage(oldX, oldY, other);
+            addDamage(state.currX, state.currY, other);
+        }
+    }
+
+    if (player == LOCAL_PLAYER)
+    {
+        updateMinimap(oldX, oldY);
+        updateMinimap(state.currX, state.currY);
     }
-    else if (myRoomGrid[myCurrY][myCurrX] & TREASURE)
+
+    if (myRooms.at(state.currX, state.currY) & WUMPUS)
     {
-        displayMessage(myMessages[WorldMessage::WIN], 0);
-        displayMessage(myMessages[WorldMessage::EXIT], 1);
-        myGameOver = true;
+        displayMessage(myMessages[WorldMessage::LOSE], 0, player);
+        displayMessage(myMessages[WorldMessage::EXIT], 1, player);
+        state.gameOver = true;
     }
-    else if (isNearWumpus())
+    else if (myRooms.at(state.currX, state.currY) & TREASURE)
     {
-        displayMessage(myMessages[WorldMessage::NEARWUMPUS], 0);
+        displayMessage(myMessages[WorldMessage::WIN], 0, player);
+        displayMessage(myMessages[myFinalLevel ? WorldMessage::EXIT : WorldMessage::NEXTLEVEL], 1, player);
+        state.gameOver = true;
+        state.won = true;
+    }
+    else if (isNearWumpus(player))
+    {
+        displayMessage(myMessages[WorldMessage::NEARWUMPUS], 0, player);
+    }
+    else if (keyFound)
+    {
+        displayMessage(myMessages[WorldMessage::KEYFOUND], 0, player);
     }
     else
     {
-        displayMessage(myMessages[WorldMessage::CLEAR], 0);
+        displayMessage(myMessages[WorldMessage::CLEAR], 0, player);
     }
 }
 
-void World::toggleWumpus()
+template<typename Storage>
+void BasicWorld<Storage>::toggleWumpus(int player)
 {
-    if (myRoomGrid[mySelectY][mySelectX] & MARK_WUMPUS)
+    PlayerState & state = *myPlayers[player];
+    int room = state.selectY * myWidth + state.selectX;
+    room_data_t & overlay = state.overlay[room];
+
+    if (overlay & MARK_WUMPUS)
     {
-        myRoomGrid[mySelectY][mySelectX] &= ~MARK_WUMPUS;
+        overlay &= ~MARK_WUMPUS;
+
+        // Keep the overlay sparse: only rooms with marks or visits have an entry.
+        if (!overlay)
+        {
+            state.overlay.erase(room);
+        }
     }
     else
     {
-        myRoomGrid[mySelectY][mySelectX] &= ~MARK_UNKNOWN;
-        myRoomGrid[mySelectY][mySelectX] |= MARK_WUMPUS;
+        overlay &= ~MARK_UNKNOWN;
+        overlay |= MARK_WUMPUS;
+        Telemetry::increment(Metric::MARKS_PLACED);
     }
 
-    renderSelectedRoom();
+    renderSelectedRoom(player);
+
+    if (player == LOCAL_PLAYER)
+    {
+        updateMinimap(state.selectX, state.selectY);
+    }
 }
 
-void World::toggleUnknown()
+template<typename Storage>
+void BasicWorld<Storage>::toggleUnknown(int player)
 {
-    if (myRoomGrid[mySelectY][mySelectX] & MARK_UNKNOWN)
+    PlayerState & state = *myPlayers[player];
+    int room = state.selectY * myWidth + state.selectX;
+    room_data_t & overlay = state.overlay[room];
+
+    if (overlay & MARK_UNKNOWN)
     {
-        myRoomGrid[mySelectY][mySelectX] &= ~MARK_UNKNOWN;
+        overlay &= ~MARK_UNKNOWN;
+
+        // Keep the overlay sparse: only rooms with marks or visits have an entry.
+        if (!overlay)
+        {
+            state.overlay.erase(room);
+        }
     }
     else
     {
-        myRoomGrid[mySelectY][mySelectX] &= ~MARK_WUMPUS;
-        myRoomGrid[mySelectY][mySelectX] |= MARK_UNKNOWN;
+        overlay &= ~MARK_WUMPUS;
+        overlay |= MARK_UNKNOWN;
+        Telemetry::increment(Metric::MARKS_PLACED);
     }
 
-    renderSelectedRoom();
+    renderSelectedRoom(player);
+
+    if (player == LOCAL_PLAYER)
+    {
+        updateMinimap(state.selectX, state.selectY);
+    }
 }
 
-void World::dumpRawData()
+template<typename Storage>
+void BasicWorld<Storage>::dumpRawData()
 {
-    myTerminal->clearScreen();
+    ITerminal * terminal = myPlayers[LOCAL_PLAYER]->terminal;
+    terminal->clearScreen();
 
     std::ostringstream oss;
     oss << "World data:\n";
@@ -292,135 +644,486 @@ void World::dumpRawData()
     {
         for (int x = 0; x < myWidth; ++x)
         {
-            oss << myRoomGrid[y][x] << ',';
+            room_data_t props = myRooms.at(x, y) | getOverlay(x, y, LOCAL_PLAYER);
+
+            if (!isRoomLocked(x, y))
+            {
+                props &= ~LOCKED;
+            }
+
+            int keyId = getKeyId(y * myWidth + x);
+
+            if ((keyId >= 0) && (getKeys() & (key_mask_t(1) << keyId)))
+            {
+                props &= ~KEY;
+            }
+
+            oss << props << ',';
         }
 
         oss.seekp(-1, oss.cur);
         oss << '\n';
     }
 
-    myTerminal->output(oss);
+    terminal->output(oss);
+}
+
+template<typename Storage>
+void BasicWorld<Storage>::resetPlayer(PlayerState & state) const
+{
+    state.currX = state.selectX = myStartX;
+    state.currY = state.selectY = myStartY;
+    state.gameOver = state.won = false;
+    state.room = myStartY * myWidth + myStartX;
+    state.overlay.clear();
+    state.overlay[state.room] = VISITED;
+    state.viewX = state.viewY = 0;
+    state.damage.clear();
+    scrollToSelection(state);
+}
+
+template<typename Storage>
+bool BasicWorld<Storage>::scrollToSelection(PlayerState & state) const
+{
+    // Scroll as little as possible to bring the selection back within the margin, staying inside the world.
+    auto scroll = [](int view, int select, int viewSize, int worldSize) {
+        int margin = std::min(VIEW_MARGIN, (viewSize - 1) / 2);
+        view = std::min(view, select - margin);
+        view = std::max(view, select + margin - viewSize + 1);
+        return std::max(0, std::min(view, worldSize - viewSize));
+    };
+
+    int viewX = scroll(state.viewX, state.selectX, getViewWidth(), myWidth);
+    int viewY = scroll(state.viewY, state.selectY, getViewHeight(), myHeight);
+
+    if ((viewX == state.viewX) && (viewY == state.viewY))
+    {
+        return false;
+    }
+
+    state.viewX = viewX;
+    state.viewY = viewY;
+    return true;
+}
+
+template<typename Storage>
+void BasicWorld<Storage>::clearView(int player) const
+{
+    ITerminal * terminal = myPlayers[player]->terminal;
+
+    if (!terminal)
+    {
+        return;
+    }
+
+    // Blank the whole view first, as invalid rooms aren't drawn over.
+    std::string blank((getViewWidth() * 4) + 1, ' ');
+
+    for (int y = 0; y <= getViewHeight() * 2; ++y)
+    {
+        terminal->setCursorPos(0, y);
+        terminal->output(blank, false);
+
+        if (player == LOCAL_PLAYER)
+        {
+            broadcast(0, y, blank);
+        }
+    }
 }
 
-void World::updateKernel(int x, int y) const
+template<typename Storage>
+void BasicWorld<Storage>::updateSelection(int oldX, int oldY, int player)
+{
+    if (scrollToSelection(*myPlayers[player]))
+    {
+        clearView(player);
+        render(player);
+    }
+    else
+    {
+        renderRoom(oldX, oldY, player);
+        renderSelectedRoom(player);
+    }
+}
+
+template<typename Storage>
+void BasicWorld<Storage>::addDamage(int x, int y, int player)
+{
+    PlayerState & state = *myPlayers[player];
+    boost::mutex::scoped_lock lock(state.damageMutex);
+    state.damage.push_back(y * myWidth + x);
+}
+
+template<typename Storage>
+void BasicWorld<Storage>::buildReachIndex()
+{
+    int roomCount = myWidth * myHeight;
+    myKeyRooms.clear();
+    myLockRooms.clear();
+
+    // Rooms are scanned in row-major order, so both lists come out sorted.
+    for (int room = 0; room < roomCount; ++room)
+    {
+        cell_t roomData = myRooms.at(room % myWidth, room / myWidth);
+
+        if (roomData & KEY)
+        {
+            if (myKeyRooms.size() == MAX_KEYS)
+                throw std::runtime_error("Too many keys in world");
+
+            myKeyRooms.push_back(room);
+        }
+
+        if (roomData & LOCKED)
+        {
+            if (myLockRooms.size() == MAX_KEYS)
+                throw std::runtime_error("Too many locks in world");
+
+            myLockRooms.push_back(room);
+        }
+    }
+
+    myKeyCount = static_cast<int>(myKeyRooms.size());
+
+    // Index one bit per (room, keys held) state: set if the treasure can be reached from there without entering
+    // a wumpus room. Built by a reverse BFS from the treasure over the state graph, so queries during play are O(1).
+    // Stepping back through a key room can only drop its key, so masks are processed from the highest down: each
+    // one is a BFS over rooms, seeded with the treasure and the states found while processing higher masks.
+    std::size_t stateCount = static_cast<std::size_t>(roomCount) << myKeyCount;
+    myReachIndex.assign((stateCount + 63) / 64, 0);
+    std::vector<int> queue;
+    queue.reserve(roomCount);
+
+    auto isSet = [this](std::size_t state) {
+        return (myReachIndex[state >> 6] >> (state & 63)) & 1;
+    };
+
+    auto set = [this](std::size_t state) {
+        myReachIndex[state >> 6] |= uint64_t(1) << (state & 63);
+    };
+
+    const int dx[] = {0, 0, -1, 1};
+    const int dy[] = {-1, 1, 0, 0};
+
+    for (key_mask_t keys = key_mask_t(1) << myKeyCount; keys-- > 0;)
+    {
+        std::size_t layer = static_cast<std::size_t>(keys) * roomCount;
+        queue.clear();
+
+        for (int room = 0; room < roomCount; ++room)
+        {
+            if ((myRooms.at(room % myWidth, room / myWidth) & (VALID | TREASURE)) == (VALID | TREASURE))
+            {
+                set(layer + room);
+            }
+
+            if (isSet(layer + room))
+            {
+                queue.push_back(room);
+            }
+        }
+
+        for (std::size_t head = 0; head < queue.size(); ++head)
+        {
+            int room = queue[head];
+            int x = room % myWidth;
+            int y = room / myWidth;
+
+            // Find the states that step into this one: entering a key room adds its key, so either mask may
+            // precede it. The one without the key belongs to a lower mask, and is only marked for now.
+            int keyId = getKeyId(room);
+            int lockId = getLockId(room);
+            key_mask_t keyBit = (keyId >= 0) ? (key_mask_t(1) << keyId) : 0;
+
+            if (keyBit && !(keys & keyBit))
+            {
+                continue;
+            }
+
+            for (int i = 0; i < 4; ++i)
+            {
+                int prevX = x + dx[i];
+                int prevY = y + dy[i];
+
+                if ((prevX < 0) || (prevX >= myWidth) || (prevY < 0) || (prevY >= myHeight) ||
+                    ((myRooms.at(prevX, prevY) & (VALID | WUMPUS)) != VALID))
+                {
+                    continue;
+                }
+
+                int prevRoom = prevY * myWidth + prevX;
+
+                if ((lockId < 0) || (keys & (key_mask_t(1) << lockId)))
+                {
+                    if (!isSet(layer + prevRoom))
+                    {
+                        set(layer + prevRoom);
+                        queue.push_back(prevRoom);
+                    }
+                }
+
+                key_mask_t prevKeys = keys & ~keyBit;
+
+                if (keyBit && ((lockId < 0) || (prevKeys & (key_mask_t(1) << lockId))))
+                {
+                    set(static_cast<std::size_t>(prevKeys) * roomCount + prevRoom);
+                }
+            }
+        }
+    }
+}
+
+template<typename Storage>
+bool BasicWorld<Storage>::isTreasureReachable(int x, int y, key_mask_t keys) const
+{
+    keys &= (key_mask_t(1) << myKeyCount) - 1;
+    std::size_t state = static_cast<std::size_t>(keys) * myWidth * myHeight + y * myWidth + x;
+    return (myReachIndex[state >> 6] >> (state & 63)) & 1;
+}
+
+template<typename Storage>
+void BasicWorld<Storage>::saveSnapshot(std::ostream & os) const
+{
+    // Only the local player's overlay is stored: positions, keys and the sparse set of rooms with marks or visits.
+    // Picked up keys and opened locks are implied by the key mask and visited rooms.
+    const PlayerState & state = *myPlayers[LOCAL_PLAYER];
+    Snapshot::write(os, myBaseHash);
+    Snapshot::write(os, static_cast<int32_t>(state.currX));
+    Snapshot::write(os, static_cast<int32_t>(state.currY));
+    Snapshot::write(os, static_cast<int32_t>(state.selectX));
+    Snapshot::write(os, static_cast<int32_t>(state.selectY));
+    Snapshot::write(os, getKeys());
+    Snapshot::write(os, static_cast<uint8_t>((state.gameOver ? 1 : 0) | (state.won ? 2 : 0)));
+
+    std::vector<std::pair<uint32_t, room_data_t>> overlay;
+
+    for (const auto & entry : state.overlay)
+    {
+        room_data_t props = entry.second & mySnapshotProps;
+
+        if (props)
+        {
+            overlay.emplace_back(entry.first, props);
+        }
+    }
+
+    // Sorted by room, so the same game always produces the same snapshot.
+    std::sort(overlay.begin(), overlay.end());
+
+    Snapshot::write(os, static_cast<uint32_t>(overlay.size()));
+
+    for (const auto & entry : overlay)
+    {
+        Snapshot::write(os, entry.first);
+        Snapshot::write(os, entry.second);
+    }
+}
+
+template<typename Storage>
+bool BasicWorld<Storage>::restoreSnapshot(std::istream & is)
+{
+    uint64_t baseHash;
+    int32_t position[4];
+    key_mask_t keys;
+    uint8_t gameOver;
+    uint32_t overlayCount;
+
+    if (!Snapshot::read(is, baseHash) || (baseHash != myBaseHash))
+    {
+        return false;
+    }
+
+    for (int32_t & value : position)
+    {
+        if (!Snapshot::read(is, value))
+        {
+            return false;
+        }
+    }
+
+    if (!Snapshot::read(is, keys) || !Snapshot::read(is, gameOver) || !Snapshot::read(is, overlayCount) ||
+        (overlayCount > static_cast<uint32_t>(myWidth * myHeight)))
+    {
+        return false;
+    }
+
+    for (int i = 0; i < 4; ++i)
+    {
+        int limit = (i % 2) ? myHeight : myWidth;
+
+        if ((position[i] < 0) || (position[i] >= limit))
+        {
+            return false;
+        }
+    }
+
+    // Read the whole overlay before applying it, so a truncated snapshot leaves the world untouched.
+    std::vector<std::pair<uint32_t, room_data_t>> overlay(overlayCount);
+
+    for (auto & entry : overlay)
+    {
+        if (!Snapshot::read(is, entry.first) || !Snapshot::read(is, entry.second) ||
+            (entry.first >= static_cast<uint32_t>(myWidth * myHeight)))
+        {
+            return false;
+        }
+    }
+
+    PlayerState & state = *myPlayers[LOCAL_PLAYER];
+    int oldX = state.currX;
+    int oldY = state.currY;
+
+    for (const auto & entry : overlay)
+    {
+        state.overlay[entry.first] |= entry.second & mySnapshotProps;
+
+        if ((entry.second & VISITED) && (getLockId(entry.first) >= 0))
+        {
+            myUnlocked |= key_mask_t(1) << getLockId(entry.first);
+        }
+    }
+
+    state.currX = position[0];
+    state.currY = position[1];
+    state.selectX = position[2];
+    state.selectY = position[3];
+    scrollToSelection(state);
+    state.room = state.currY * myWidth + state.currX;
+    myKeys |= keys;
+    state.gameOver = (gameOver & 1);
+    state.won = (gameOver & 2);
+
+    for (const auto & entry : overlay)
+    {
+        updateMinimap(entry.first % myWidth, entry.first / myWidth);
+    }
+
+    updateMinimap(oldX, oldY);
+    updateMinimap(state.currX, state.currY);
+    return true;
+}
+
+template<typename Storage>
+void BasicWorld<Storage>::updateKernel(int x, int y, Kernel & kernel) const
 {
     if (x == 0)
     {
-        myKernel[0][0] = myKernel[1][0] = myKernel[2][0] = false;
+        kernel[0][0] = kernel[1][0] = kernel[2][0] = false;
 
         if (y == 0)
         {
-            myKernel[0][1] = myKernel[0][2] = false;
-            myKernel[1][1] = (myRoomGrid[y][x] & VALID);
-            myKernel[1][2] = (myRoomGrid[y][x + 1] & VALID);
-            myKernel[2][1] = (myRoomGrid[y + 1][x] & VALID);
-            myKernel[2][2] = (myRoomGrid[y + 1][x + 1] & VALID);
+            kernel[0][1] = kernel[0][2] = false;
+            kernel[1][1] = (myRooms.at(x, y) & VALID);
+            kernel[1][2] = (myRooms.at(x + 1, y) & VALID);
+            kernel[2][1] = (myRooms.at(x, y + 1) & VALID);
+            kernel[2][2] = (myRooms.at(x + 1, y + 1) & VALID);
         }
         else if (y < myHeight - 1)
         {
-            myKernel[0][1] = (myRoomGrid[y - 1][x] & VALID);
-            myKernel[0][2] = (myRoomGrid[y - 1][x + 1] & VALID);
-            myKernel[1][1] = (myRoomGrid[y][x] & VALID);
-            myKernel[1][2] = (myRoomGrid[y][x + 1] & VALID);
-            myKernel[2][1] = (myRoomGrid[y + 1][x] & VALID);
-            myKernel[2][2] = (myRoomGrid[y + 1][x + 1] & VALID);
+            kernel[0][1] = (myRooms.at(x, y - 1) & VALID);
+            kernel[0][2] = (myRooms.at(x + 1, y - 1) & VALID);
+            kernel[1][1] = (myRooms.at(x, y) & VALID);
+            kernel[1][2] = (myRooms.at(x + 1, y) & VALID);
+            kernel[2][1] = (myRooms.at(x, y + 1) & VALID);
+            kernel[2][2] = (myRooms.at(x + 1, y + 1) & VALID);
         }
         else
         {
-            myKernel[0][1] = (myRoomGrid[y - 1][x] & VALID);
-            myKernel[0][2] = (myRoomGrid[y - 1][x + 1] & VALID);
-            myKernel[1][1] = (myRoomGrid[y][x] & VALID);
-            myKernel[1][2] = (myRoomGrid[y][x + 1] & VALID);
-            myKernel[2][1] = myKernel[2][2] = false;
+            kernel[0][1] = (myRooms.at(x, y - 1) & VALID);
+            kernel[0][2] = (myRooms.at(x + 1, y - 1) & VALID);
+            kernel[1][1] = (myRooms.at(x, y) & VALID);
+            kernel[1][2] = (myRooms.at(x + 1, y) & VALID);
+            kernel[2][1] = kernel[2][2] = false;
         }
     }
     else if (x < myWidth - 1) 
     {
         if (y == 0)
         {
-            myKernel[0][0] = myKernel[0][1] = myKernel[0][2] = false;
-            myKernel[1][0] = (myRoomGrid[y][x - 1] & VALID);
-            myKernel[1][1] = (myRoomGrid[y][x] & VALID);
-            myKernel[1][2] = (myRoomGrid[y][x + 1] & VALID);
-            myKernel[2][0] = (myRoomGrid[y + 1][x - 1] & VALID);
-            myKernel[2][1] = (myRoomGrid[y + 1][x] & VALID);
-            myKernel[2][2] = (myRoomGrid[y + 1][x + 1] & VALID);
+            kernel[0][0] = kernel[0][1] = kernel[0][2] = false;
+            kernel[1][0] = (myRooms.at(x - 1, y) & VALID);
+            kernel[1][1] = (myRooms.at(x, y) & VALID);
+            kernel[1][2] = (myRooms.at(x + 1, y) & VALID);
+            kernel[2][0] = (myRooms.at(x - 1, y + 1) & VALID);
+            kernel[2][1] = (myRooms.at(x, y + 1) & VALID);
+            kernel[2][2] = (myRooms.at(x + 1, y + 1) & VALID);
         }
         else if (y < myHeight - 1)
         {
-            myKernel[0][0] = (myRoomGrid[y - 1][x - 1] & VALID);
-            myKernel[0][1] = (myRoomGrid[y - 1][x] & VALID);
-            myKernel[0][2] = (myRoomGrid[y - 1][x + 1] & VALID);
-            myKernel[1][0] = (myRoomGrid[y][x - 1] & VALID);
-            myKernel[1][1] = (myRoomGrid[y][x] & VALID);
-            myKernel[1][2] = (myRoomGrid[y][x + 1] & VALID);
-            myKernel[2][0] = (myRoomGrid[y + 1][x - 1] & VALID);
-            myKernel[2][1] = (myRoomGrid[y + 1][x] & VALID);
-            myKernel[2][2] = (myRoomGrid[y + 1][x + 1] & VALID);
+            kernel[0][0] = (myRooms.at(x - 1, y - 1) & VALID);
+            kernel[0][1] = (myRooms.at(x, y - 1) & VALID);
+            kernel[0][2] = (myRooms.at(x + 1, y - 1) & VALID);
+            kernel[1][0] = (myRooms.at(x - 1, y) & VALID);
+            kernel[1][1] = (myRooms.at(x, y) & VALID);
+            kernel[1][2] = (myRooms.at(x + 1, y) & VALID);
+            kernel[2][0] = (myRooms.at(x - 1, y + 1) & VALID);
+            kernel[2][1] = (myRooms.at(x, y + 1) & VALID);
+            kernel[2][2] = (myRooms.at(x + 1, y + 1) & VALID);
         }
         else
         {
-            myKernel[0][0] = (myRoomGrid[y - 1][x - 1] & VALID);
-            myKernel[0][1] = (myRoomGrid[y - 1][x] & VALID);
-            myKernel[0][2] = (myRoomGrid[y - 1][x + 1] & VALID);
-            myKernel[1][0] = (myRoomGrid[y][x - 1] & VALID);
-            myKernel[1][1] = (myRoomGrid[y][x] & VALID);
-            myKernel[1][2] = (myRoomGrid[y][x + 1] & VALID);
-            myKernel[2][0] = myKernel[2][1] = myKernel[2][2] = false;
+            kernel[0][0] = (myRooms.at(x - 1, y - 1) & VALID);
+            kernel[0][1] = (myRooms.at(x, y - 1) & VALID);
+            kernel[0][2] = (myRooms.at(x + 1, y - 1) & VALID);
+            kernel[1][0] = (myRooms.at(x - 1, y) & VALID);
+            kernel[1][1] = (myRooms.at(x, y) & VALID);
+            kernel[1][2] = (myRooms.at(x + 1, y) & VALID);
+            kernel[2][0] = kernel[2][1] = kernel[2][2] = false;
         }
     }
     else
     {
-        myKernel[0][2] = myKernel[1][2] = myKernel[2][2] = false;
+        kernel[0][2] = kernel[1][2] = kernel[2][2] = false;
 
         if (y == 0)
         {
-            myKernel[0][0] = myKernel[0][1] = false;
-            myKernel[1][0] = (myRoomGrid[y][x - 1] & VALID);
-            myKernel[1][1] = (myRoomGrid[y][x] & VALID);
-            myKernel[2][0] = (myRoomGrid[y + 1][x - 1] & VALID);
-            myKernel[2][1] = (myRoomGrid[y + 1][x] & VALID);
+            kernel[0][0] = kernel[0][1] = false;
+            kernel[1][0] = (myRooms.at(x - 1, y) & VALID);
+            kernel[1][1] = (myRooms.at(x, y) & VALID);
+            kernel[2][0] = (myRooms.at(x - 1, y + 1) & VALID);
+            kernel[2][1] = (myRooms.at(x, y + 1) & VALID);
         }
         else if (y < myHeight - 1)
         {
-            myKernel[0][0] = (myRoomGrid[y - 1][x - 1] & VALID);
-            myKernel[0][1] = (myRoomGrid[y - 1][x] & VALID);
-            myKernel[1][0] = (myRoomGrid[y][x - 1] & VALID);
-            myKernel[1][1] = (myRoomGrid[y][x] & VALID);
-            myKernel[2][0] = (myRoomGrid[y + 1][x - 1] & VALID);
-            myKernel[2][1] = (myRoomGrid[y + 1][x] & VALID);
+            kernel[0][0] = (myRooms.at(x - 1, y - 1) & VALID);
+            kernel[0][1] = (myRooms.at(x, y - 1) & VALID);
+            kernel[1][0] = (myRooms.at(x - 1, y) & VALID);
+            kernel[1][1] = (myRooms.at(x, y) & VALID);
+            kernel[2][0] = (myRooms.at(x - 1, y + 1) & VALID);
+            kernel[2][1] = (myRooms.at(x, y + 1) & VALID);
         }
         else
         {
-            myKernel[0][0] = (myRoomGrid[y - 1][x - 1] & VALID);
-            myKernel[0][1] = (myRoomGrid[y - 1][x] & VALID);
-            myKernel[1][0] = (myRoomGrid[y][x - 1] & VALID);
-            myKernel[1][1] = (myRoomGrid[y][x] & VALID);
-            myKernel[2][0] = myKernel[2][1] = false;
+            kernel[0][0] = (myRooms.at(x - 1, y - 1) & VALID);
+            kernel[0][1] = (myRooms.at(x, y - 1) & VALID);
+            kernel[1][0] = (myRooms.at(x - 1, y) & VALID);
+            kernel[1][1] = (myRooms.at(x, y) & VALID);
+            kernel[2][0] = kernel[2][1] = false;
         }
     }
 }
 
-std::string World::getCornerStyle(int xKernel, int yKernel, int drawStyle) const
+template<typename Storage>
+std::string BasicWorld<Storage>::getCornerStyle(const Kernel & kernel, int xKernel, int yKernel, int drawStyle) const
 {
     int cornerIndex = 0;
 
-    if (myKernel[yKernel][xKernel])
+    if (kernel[yKernel][xKernel])
     {
         cornerIndex |= RoomAdjacency::TOPLEFT;
     }
 
-    if (myKernel[yKernel][xKernel + 1])
+    if (kernel[yKernel][xKernel + 1])
     {
         cornerIndex |= RoomAdjacency::TOPRIGHT;
     }
 
-    if (myKernel[yKernel + 1][xKernel])
+    if (kernel[yKernel + 1][xKernel])
     {
         cornerIndex |= RoomAdjacency::BOTTOMLEFT;
     }
 
-    if (myKernel[yKernel + 1][xKernel + 1])
+    if (kernel[yKernel + 1][xKernel + 1])
     {
         cornerIndex |= RoomAdjacency::BOTTOMRIGHT;
     }
@@ -428,21 +1131,34 @@ std::string World::getCornerStyle(int xKernel, int yKernel, int drawStyle) const
     return myCornerStyles[cornerIndex][drawStyle];
 }
 
-std::string World::getRoomContent(int x, int y) const
+template<typename Storage>
+std::string BasicWorld<Storage>::getRoomContent(int x, int y, int player) const
 {
-    if ((x == myCurrX) && (y == myCurrY))
+    const PlayerState & state = *myPlayers[player];
+    int room = y * myWidth + x;
+    room_data_t overlay = getOverlay(x, y, player);
+
+    if ((x == state.currX) && (y == state.currY))
     {
         return mySpecialSymbols[SpecialSymbol::FACE];
     }
-    else if (myRoomGrid[y][x] & LOCKED)
+    else if (isOtherPlayerIn(room, player))
+    {
+        return mySpecialSymbols[SpecialSymbol::PLAYER];
+    }
+    else if (isRoomLocked(x, y))
     {
         return mySpecialSymbols[SpecialSymbol::LOCKED];
     }
-    else if (myRoomGrid[y][x] & MARK_WUMPUS)
+    else if ((myRooms.at(x, y) & KEY) && !(getKeys() & (key_mask_t(1) << getKeyId(room))))
+    {
+        return mySpecialSymbols[SpecialSymbol::KEY];
+    }
+    else if (overlay & MARK_WUMPUS)
     {
         return mySpecialSymbols[SpecialSymbol::WUMPUS];
     }
-    else if (myRoomGrid[y][x] & MARK_UNKNOWN)
+    else if (overlay & MARK_UNKNOWN)
     {
         return mySpecialSymbols[SpecialSymbol::UNKNOWN];
     }
@@ -452,24 +1168,28 @@ std::string World::getRoomContent(int x, int y) const
     }
 }
 
-bool World::isNearWumpus() const
+template<typename Storage>
+bool BasicWorld<Storage>::isNearWumpus(int player) const
 {
-    if ((myCurrX > 0) && (myRoomGrid[myCurrY][myCurrX - 1] & WUMPUS))
+    int x = myPlayers[player]->currX;
+    int y = myPlayers[player]->currY;
+
+    if ((x > 0) && (myRooms.at(x - 1, y) & WUMPUS))
     {
         return true;
     }
 
-    if ((myCurrX < myWidth - 1) && (myRoomGrid[myCurrY][myCurrX + 1] & WUMPUS))
+    if ((x < myWidth - 1) && (myRooms.at(x + 1, y) & WUMPUS))
     {
         return true;
     }
 
-    if ((myCurrY > 0) && (myRoomGrid[myCurrY - 1][myCurrX] & WUMPUS))
+    if ((y > 0) && (myRooms.at(x, y - 1) & WUMPUS))
     {
         return true;
     }
 
-    if ((myCurrY < myHeight - 1) && (myRoomGrid[myCurrY + 1][myCurrX] & WUMPUS))
+    if ((y < myHeight - 1) && (myRooms.at(x, y + 1) & WUMPUS))
     {
         return true;
     }
@@ -477,8 +1197,131 @@ bool World::isNearWumpus() const
     return false;
 }
 
-void World::displayMessage(const std::string & message, int messageLine) const
+template<typename Storage>
+void BasicWorld<Storage>::displayMessage(const std::string & message, int messageLine, int player) const
 {
-    myTerminal->setCursorPos(0, (myHeight * 2) + 1 + messageLine);
-    myTerminal->output(message);
+    ITerminal * terminal = myPlayers[player]->terminal;
+
+    if (!terminal)
+    {
+        return;
+    }
+
+    terminal->setCursorPos(0, (getViewHeight() * 2) + 1 + messageLine);
+    terminal->output(message);
+
+    if (player == LOCAL_PLAYER)
+    {
+        broadcast(0, (getViewHeight() * 2) + 1 + messageLine, message);
+    }
+
+    Telemetry::increment(Metric::BYTES_WRITTEN, message.size());
+}
+
+template<typename Storage>
+void BasicWorld<Storage>::broadcast(int x, int y, const std::string & text) const
+{
+    if (myBroadcaster)
+    {
+        myBroadcaster->draw(x, y, text);
+    }
 }
+
+template<typename Storage>
+uint8_t BasicWorld<Storage>::getMinimapProps(int x, int y) const
+{
+    // The minimap shows the local player's view.
+    uint8_t props = 0;
+    room_data_t overlay = getOverlay(x, y, LOCAL_PLAYER);
+
+    if (myRooms.at(x, y) & VALID)
+    {
+        props |= MinimapProp::VALID;
+    }
+
+    if (overlay & MARK_WUMPUS)
+    {
+        props |= MinimapProp::MARK_WUMPUS;
+    }
+
+    if (overlay & VISITED)
+    {
+        props |= MinimapProp::VISITED;
+    }
+
+    if ((x == myPlayers[LOCAL_PLAYER]->currX) && (y == myPlayers[LOCAL_PLAYER]->currY))
+    {
+        props |= MinimapProp::PLAYER;
+    }
+
+    return props;
+}
+
+template<typename Storage>
+void BasicWorld<Storage>::buildMinimap()
+{
+    myMinimap.resize(myWidth, myHeight, MINIMAP_COLUMNS, MINIMAP_ROWS,
+        [this](int x, int y) { return getMinimapProps(x, y); });
+    myMinimap.buildLevels();
+}
+
+template<typename Storage>
+void BasicWorld<Storage>::updateMinimap(int x, int y)
+{
+    if (myMinimap.update(x, y))
+    {
+        renderMinimapCell(x >> myMinimap.getDisplayLevel(), y >> myMinimap.getDisplayLevel());
+    }
+}
+
+template<typename Storage>
+void BasicWorld<Storage>::renderMinimap() const
+{
+    for (int y = 0; y < myMinimap.getDisplayHeight(); ++y)
+    {
+        for (int x = 0; x < myMinimap.getDisplayWidth(); ++x)
+        {
+            renderMinimapCell(x, y);
+        }
+    }
+}
+
+template<typename Storage>
+void BasicWorld<Storage>::renderMinimapCell(int x, int y) const
+{
+    ITerminal * terminal = myPlayers[LOCAL_PLAYER]->terminal;
+
+    if (!terminal)
+    {
+        return;
+    }
+
+    // The minimap panel sits to the right of the world, one character per summary cell.
+    uint8_t props = myMinimap.getDisplayCell(x, y);
+    const std::string * symbol = &myMinimapSymbols[0];
+
+    if (props & MinimapProp::PLAYER)
+    {
+        symbol = &mySpecialSymbols[SpecialSymbol::FACE];
+    }
+    else if (props & MinimapProp::MARK_WUMPUS)
+    {
+        symbol = &mySpecialSymbols[SpecialSymbol::WUMPUS];
+    }
+    else if (props & MinimapProp::VISITED)
+    {
+        symbol = &myMinimapSymbols[2];
+    }
+    else if (props & MinimapProp::VALID)
+    {
+        symbol = &myMinimapSymbols[1];
+    }
+
+    terminal->setCursorPos(getMinimapLeft() + x, y);
+    terminal->output(*symbol, false);
+    broadcast(getMinimapLeft() + x, y, *symbol);
+    Telemetry::increment(Metric::BYTES_WRITTEN, symbol->size());
+}
+
+// Instantiate the storage policy selected for World.
+template class BasicWorld<WorldStorage>;
@@ -1,18 +1,232 @@
 ﻿#include "Game.h"
+#include "Solver.h"
+#include "Tournament.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <stdexcept>
+#include <string>
+#include <vector>
 
 
-int main()
+// Watches a game broadcast from another process on this terminal: --spectate <pid>
+static void runSpectator(const std::string & name)
+{
+    OSTerminal terminal;
+
+    if (!terminal.initialize())
+        throw std::runtime_error("Terminal initialization failed");
+
+    if (!terminal.setMode(eTermMode::TM_GAME))
+        throw std::runtime_error("Terminal setMode failed");
+
+    SpectatorViewer viewer(name, &terminal);
+    bool attached = false;
+
+    while (true)
+    {
+        kb_codes_vec kbCodes;
+
+        if (terminal.pollKeys(kbCodes) && ((kbCodes[0] == KB_Q) || (kbCodes[0] == KB_ESCAPE)))
+        {
+            break;
+        }
+
+        // Keep trying until a game starts broadcasting.
+        if (attached || (attached = viewer.attach()))
+        {
+            viewer.update();
+        }
+
+        boost::this_thread::sleep(boost::posix_time::millisec(attached ? 10 : 100));
+    }
+}
+
+// Plays the built-in agents headless against the given world files, or else every level of the campaign:
+//  --tournament [gamesPerPair] [threads] [csvPath] [--random-wumpuses] [worldFile...]
+// Worlds are played as designed, or with the wumpuses placed afresh for every game with --random-wumpuses.
+static void runTournament(int argc, char * argv[])
+{
+    int gamesPerPair = (argc > 2) ? std::stoi(argv[2]) : 10000;
+    int threadCount = (argc > 3) ? std::stoi(argv[3]) : 0;
+    std::string csvPath = (argc > 4) ? argv[4] : "tournament.csv";
+    int nextArg = 5;
+    bool randomWumpuses = false;
+
+    if ((argc > nextArg) && (std::string(argv[nextArg]) == "--random-wumpuses"))
+    {
+        randomWumpuses = true;
+        ++nextArg;
+    }
+
+    Tournament tournament;
+    std::vector<std::vector<room_data_t>> worldData(std::max(argc - nextArg, 0));
+
+    for (int i = nextArg; i < argc; ++i)
+    {
+        std::ifstream ifs(argv[i]);
+        World::RawData rawData;
+
+        if (!World::readRawData(ifs, worldData[i - nextArg], rawData))
+            throw std::runtime_error(std::string("Failed to read world file ") + argv[i]);
+
+        tournament.addWorld(rawData, randomWumpuses);
+    }
+
+    if (worldData.empty())
+    {
+        for (int level = 0; level < World::getLevelCount(); ++level)
+        {
+            tournament.addWorld(World::getLevelRawData(level), randomWumpuses);
+        }
+    }
+
+    tournament.addAgent([]() { return std::make_unique<RandomAgent>(); });
+    tournament.addAgent([]() { return std::make_unique<CautiousAgent>(); });
+
+    auto startTime = std::chrono::steady_clock::now();
+    tournament.run(gamesPerPair, threadCount);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    std::ofstream ofs(csvPath);
+    tournament.writeCsv(ofs);
+
+    if (!ofs)
+        throw std::runtime_error("Failed to write " + csvPath);
+
+    tournament.writeCsv(std::cout);
+    std::cout << "Finished in " << seconds << "s, results written to " << csvPath << std::endl;
+}
+
+// Plays cautious agents together in one shared world of the campaign, headless, each on its own thread. Players
+// join one at a time while the earlier ones are already playing: --coop [players] [level]
+static void runCoop(int argc, char * argv[])
+{
+    int playerCount = (argc > 2) ? std::stoi(argv[2]) : 4;
+    int level = (argc > 3) ? std::stoi(argv[3]) : 0;
+
+    if ((playerCount < 1) || (playerCount > World::MAX_PLAYERS))
+        throw std::runtime_error("Players must be between 1 and " + std::to_string(World::MAX_PLAYERS));
+
+    if ((level < 0) || (level >= World::getLevelCount()))
+        throw std::runtime_error("Level must be between 0 and " + std::to_string(World::getLevelCount() - 1));
+
+    World world(nullptr, World::getLevelRawData(level));
+    int maxMoves = 4 * world.getWidth() * world.getHeight();
+    std::vector<int> moveCounts(playerCount, 0);
+    boost::thread_group players;
+
+    for (int i = 0; i < playerCount; ++i)
+    {
+        int player = (i == 0) ? World::LOCAL_PLAYER : world.addPlayer(nullptr);
+
+        players.create_thread([&world, &moveCounts, player, maxMoves]() {
+            CautiousAgent agent;
+            // Seeded per player, so they don't all break ties the same way.
+            agent.reset(world, static_cast<uint32_t>(player));
+
+            while (!world.isGameOver(player) && (moveCounts[player] < maxMoves))
+            {
+                int x = world.getCurrX(player);
+                int y = world.getCurrY(player);
+
+                switch (agent.chooseMove(world, player))
+                {
+                case World::MoveDirection::up:
+                    --y;
+                    break;
+
+                case World::MoveDirection::down:
+                    ++y;
+                    break;
+
+                case World::MoveDirection::left:
+                    --x;
+                    break;
+
+                case World::MoveDirection::right:
+                    ++x;
+                    break;
+                }
+
+                world.setSelection(x, y, player);
+                world.move(player);
+                ++moveCounts[player];
+            }
+        });
+
+        boost::this_thread::sleep(boost::posix_time::millisec(1));
+    }
+
+    players.join_all();
+
+    for (int player = 0; player < playerCount; ++player)
+    {
+        std::cout << "Player " << player << ": " <<
+            (world.isWon(player) ? "won" : (world.isGameOver(player) ? "lost" : "gave up")) << " after " <<
+            moveCounts[player] << " moves" << std::endl;
+    }
+}
+
+
+int main(int argc, char * argv[])
 {
     try
     {
-        Game game;
+        // Solves one level of the campaign: --solve [level]
+        if ((argc > 1) && (std::string(argv[1]) == "--solve"))
+        {
+            int level = (argc > 2) ? std::stoi(argv[2]) : 0;
+
+            if ((level < 0) || (level >= World::getLevelCount()))
+                throw std::runtime_error("Level must be between 0 and " + std::to_string(World::getLevelCount() - 1));
+
+            Solver solver(World::getLevelRawData(level));
+            double winProbability = solver.solve();
+            std::cout << "Optimal win probability: " << winProbability << " (" <<
+                solver.getStatesExplored() << " states explored)" << std::endl;
+            return 0;
+        }
+
+        if ((argc > 1) && (std::string(argv[1]) == "--spectate"))
+        {
+            if (argc < 3)
+                throw std::runtime_error("Usage: wumpus --spectate <pid of the game>");
+
+            runSpectator(SpectatorBroadcaster::getName(std::stoi(argv[2])));
+            return 0;
+        }
+
+        if ((argc > 1) && (std::string(argv[1]) == "--coop"))
+        {
+            runCoop(argc, argv);
+            return 0;
+        }
+
+        if ((argc > 1) && (std::string(argv[1]) == "--tournament"))
+        {
+            runTournament(argc, argv);
+            return 0;
+        }
+
+        // Games are saved per player, named by --player or else the login name: --player name
+        const char * user = std::getenv("USER");
+        std::string player = user ? user : "player";
+
+        if ((argc > 2) && (std::string(argv[1]) == "--player"))
+        {
+            player = argv[2];
+        }
+
+        Game game(player);
         game.initialize();
         game.executiveLoop();
     }
-    catch (std::runtime_error & e)
+    catch (std::exception & e)
     {
+        // Also reports bad numeric arguments, which std::stoi rejects with std::invalid_argument or out_of_range.
         std::cerr << "Exception: " << e.what() << std::endl;
     }
 